@@ -5,6 +5,7 @@
  * This is a simple example of how to call a JavaFX application from C code using JNI.
  * Notes that the JavaFX application is in a module called fishFeederGUI.
  * The JNIEnv is thread specific.  Can't use JNIEnv from another thread.
+ * Any C thread may call the fish.h functions, each is attached to the JVM with its own JNIEnv when first needed.
  * The JavaVM is global and can be used in any thread.
  * The JavaFX application is started in the main thread and then the C processing thread is started.
  * The C processing thread sends messages to the JavaFX application using the
@@ -42,10 +43,18 @@
 #include <jni.h>
 
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
 
 #include "fish.h"
+#include "fish_ring.h"
+#include "fish_stats.h"
+#include "fish_fb.h"
+#include "fish_ssd1306.h"
+#include "fish_fmt.h"
 
 // it is possible to output various levels of debug info from the Fish GUI Emulator Java and C code
 // the following constants are used to select what to output to the console log.
@@ -63,7 +72,7 @@ int  log_level = 0; // global that stores the current log level setting
 
 JavaVM *vm;
 JNIEnv *env_fx; // jvm environment for JavaFX thread
-JNIEnv *env_c; // jvm environment for C processing thread
+_Thread_local JNIEnv *env_c; // jvm environment for the calling thread (see attachCurrentThread())
 
 // the java classes, methods and signatures type names we need
 // Note: to find method signature strings for a java class use jdk tool: javap -s -p FishFeederEmulator.class
@@ -79,6 +88,22 @@ char const *const jmethod_name_emulator_exit = "exit";
 char const *const jmethod_sig_emulator_exit = "([Ljava/lang/String;)V";
 char const *const jmethod_name_isGUIReady = "isGUIReady";
 char const *const jmethod_sig_isGUIReady = "()Z";
+char const *const jmethod_name_frame = "frame";
+char const *const jmethod_sig_frame = "(Ljava/lang/String;)V";
+char const *const jmethod_name_attach_ring = "attachCommandRing";
+char const *const jmethod_sig_attach_ring = "(Ljava/nio/ByteBuffer;)V";
+char const *const jmethod_name_display_frame = "displayFrame";
+char const *const jmethod_sig_display_frame = "(Ljava/nio/ByteBuffer;)V";
+char const *const jmethod_name_display_update = "displayUpdate";
+char const *const jmethod_sig_display_update = "(Ljava/nio/ByteBuffer;I)V";
+char const *const jmethod_name_rtc = "rtc";
+char const *const jmethod_sig_rtc = "(I)I";
+char const *const jmethod_name_rtc_warm_start = "rtcWarmStart";
+char const *const jmethod_sig_rtc_warm_start = "(J)J";
+char const *const jnative_name_button_event = "buttonEvent";
+char const *const jnative_sig_button_event = "(I)V";
+char const *const jnative_name_gui_ready = "guiReady";
+char const *const jnative_sig_gui_ready = "()V";
 char const *const jmethod_name_platform_exit = "exit";
 char const *const jmethod_sig_platform_exit = "()V";
 char const *const jclass_name_String = "java/lang/String";
@@ -90,20 +115,202 @@ char const *const jclass_name_Platform = "javafx/application/Platform";
 jclass jclass_FishFeederEmulator = NULL; // our fish feeder emulator class
 jmethodID jmethod_command = NULL; // to send commands to the fish feeder emulator
 jmethodID jmethod_message = NULL; // to ask the fish feeder emulator for information
+jmethodID jmethod_rtc = NULL; // to read a clock item as a number (NULL if the emulator can't, use message)
+jmethodID jmethod_rtc_warm_start = NULL; // clock warm start with a number (NULL if the emulator can't)
 jmethodID jmethod_exit = NULL;
 jmethodID jmethod_isGUIReady = NULL; // to check if the GUI is ready
+jmethodID jmethod_frame = NULL; // to send a whole frame of display commands (NULL if the emulator can't)
+jmethodID jmethod_attach_ring = NULL; // to share the binary command ring (NULL if the emulator can't)
+jmethodID jmethod_display_frame = NULL; // to upload the whole framebuffer (NULL if the emulator can't)
+jmethodID jmethod_display_update = NULL; // to upload only the changed display regions (NULL if the emulator can't)
 jclass jclass_String = NULL; // java string class to pass strings to/from java methods
 jclass jclass_Platform = NULL; // java fx Platform class
 jmethodID jmethod_platform_exit = NULL; // Platform.exit() method
 
-// thread management we need javaFX and C processing threads
-#define MAX_THREADS 2
-int threadCount = 0;
-pthread_t threads[MAX_THREADS];
+// thread management we need javaFX and C processing threads (and the async worker thread if used)
+// any other thread may also use the API, it is attached to the JVM the first time it needs to be
+pthread_t c_thread; // C processing thread running userProcessing()
+pthread_t async_thread; // async JNI worker thread
+atomic_int thread_numbers = 0; // number of threads that have been given a thread number
+_Thread_local int thread_number = -1; // this threads number for log messages, -1 until first needed
+// lifecycle signalling between the JavaFX (main) thread and the C processing thread
+#define GUI_READY_TIMEOUT_MS 30000L // give up if the GUI has not started by then
+#define GUI_READY_POLL_MS 50L // interval for checking isGUIReady() when the emulator does not call guiReady()
+pthread_mutex_t lifecycle_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t lifecycle_cond = PTHREAD_COND_INITIALIZER; // signalled when any of the following change
+bool gui_ready = false; // set by the native FishFeederEmulator.guiReady() method
+bool gui_thread_waiting = false; // the JavaFX thread is waiting for userProcessing() to finish
+bool shutdown_requested = false; // userProcessing() has finished
+pthread_key_t detach_key; // key whose destructor detaches lazily attached threads from the JVM
+pthread_once_t detach_key_once = PTHREAD_ONCE_INIT;
 
 #define LINE_SIZE 200
+
+// JVM launch options. extra options (GC, heap size etc.) are taken from the FISH_JVM_OPTIONS environment
+// variable (separated by spaces) or, if that is not set, from the jvm.options file in the working directory
+// (one option per line, # starts a comment line). e.g. FISH_JVM_OPTIONS="-XX:+UseSerialGC -Xmx64m"
+#define JVM_OPTIONS_ENV "FISH_JVM_OPTIONS"
+#define JVM_OPTIONS_FILE "jvm.options"
+#define JVM_CDS_ARCHIVE "fishFeederGUI.jsa" // class data sharing archive made by the appcds build target
+#define MAX_JVM_OPTIONS 32
+#define JVM_OPTIONS_TEXT_SIZE 2048
+char jvm_options_text[JVM_OPTIONS_TEXT_SIZE]; // option strings point into this
+char jvm_cds_option[LINE_SIZE];
+JavaVMOption jvm_options[MAX_JVM_OPTIONS];
+long long jvm_start_ms = 0; // when jniSetup() started the JVM, for startup time reporting
+long long startup_ms = 0; // when jniSetup() was called, for the time to first frame
+atomic_bool first_frame_sent = false;
+
+// running totals for jniCounts()
+atomic_ulong count_frames = 0;
+atomic_ulong count_display_commands = 0;
+atomic_ulong count_jni_calls = 0;
+
+// optional preparation run in parallel with the JVM and GUI starting, see jniPrepare()
+void (*prepare_function)() = NULL;
+pthread_t prepare_thread;
+bool prepare_started = false;
+
+// jni call path. opcodes and small numbers are converted to java strings once and kept as global references
+#define INTERN_TABLE_SIZE 32 // maximum number of interned opcode strings
+#define INTERN_TEXT_SIZE 24 // maximum length of an interned string
+#define NUMBER_CACHE_SIZE 256 // numbers 0..255 (display coordinates) are interned
+#define LOCAL_FRAME_CAPACITY 16 // jni local references needed by a single command or message call
+
+struct InternedString {
+    char text[INTERN_TEXT_SIZE];
+    jstring jstr;
+} intern_table[INTERN_TABLE_SIZE];
+int intern_count = 0;
+
+jstring jstr_numbers[NUMBER_CACHE_SIZE];
+
+// argument arrays for messages that consist of only an opcode
+struct MessageArgs {
+    char text[INTERN_TEXT_SIZE];
+    jobjectArray jargs;
+} message_args[INTERN_TABLE_SIZE];
+int message_args_count = 0;
+pthread_mutex_t message_args_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define NUM_SCROLL_ITEMS_ON_SCREEN 5
 
+// display commands issued between displayBeginFrame() and displayEndFrame() are recorded
+// as lines of tab separated arguments and sent to the emulator in a single call
+#define FRAME_BUFFER_SIZE 8192
+// each thread builds its own frames
+_Thread_local char frame_buffer[FRAME_BUFFER_SIZE];
+_Thread_local size_t frame_length = 0; // occupied length of frame_buffer
+_Thread_local int frame_commands = 0; // number of commands recorded in frame_buffer
+_Thread_local int frame_depth = 0; // nesting level of displayBeginFrame() calls
+
+// binary command ring shared with the emulator (see fish_ring.h). NULL if the emulator does not support it
+// the display is drawn into a framebuffer by the shared C rasterizer (see fish_fb.h). if the emulator
+// has a displayUpdate() or displayFrame() method the framebuffer is uploaded once per frame instead of
+// sending display commands. only the regions that changed since the last frame are sent by displayUpdate()
+// and nothing is sent for an unchanged frame
+FrameBuffer display_buffer = {.fg = FbLit, .bg = FbUnlit};
+FbPresenter display_presenter;
+pthread_mutex_t display_mutex = PTHREAD_MUTEX_INITIALIZER; // held while drawing and while java copies the frame
+bool display_uploads = false; // the framebuffer is uploaded instead of sending display commands
+jobject display_frame_buffer = NULL; // global reference to a direct ByteBuffer of display_buffer.pages
+uint8_t display_update[FB_UPDATE_SIZE]; // packed dirty regions for displayUpdate()
+jobject display_update_buffer = NULL; // global reference to a direct ByteBuffer of display_update
+// model of the real display controller. each frame shown is also sent to it to count the I2C bytes and bus
+// time the real hardware would need (see fish_ssd1306.h). the bus time per frame is in the jni statistics
+Ssd1306 display_ssd;
+
+// without uploads the display commands of a frame are not sent again if they are the same as the previous
+// frame (and start with the same colours). the commands only overwrite pixels so the result would be the same.
+// INVERT_AREA would break that but it never reaches the frame: it goes through the command ring, or it is sent
+// as commands that redraw the area (see displayInvertArea())
+_Thread_local char frame_colour[LINE_SIZE]; // colour command in effect at the start of the frame being built
+_Thread_local bool frame_split = false; // part of the frame being built was sent early (the buffer filled up)
+char current_colour[LINE_SIZE] = ""; // last colour command, "" for the emulator default
+char last_frame[FRAME_BUFFER_SIZE]; // commands of the last frame sent
+char last_frame_colour[LINE_SIZE];
+size_t last_frame_length = 0;
+unsigned long frames_unchanged = 0;
+
+// frame pacing. at most display_fps frames a second are presented, a frame ended sooner after the last one is
+// held back and its commands are combined with the following frames until it is due (see displayFrameRate()).
+// frames are presented by displayEndFrame(), msleep() and the button functions once they are due
+int display_fps = 0; // 0 for no limit
+_Thread_local bool frame_pending = false; // a finished frame is waiting to be presented
+_Thread_local long long frame_presented_ms = 0; // monotonic milliseconds when this thread last presented a frame
+
+// display power (see displayPower()). while the display is off the drawing functions return straight away so
+// nothing is drawn into the framebuffer or sent to the emulator, and frames are not presented
+enum DisplayPower display_power = DisplayOn;
+bool display_blanking = false; // the frame that cleared the display when it was turned off is still to be sent
+
+// shadow of the emulator display state so that display commands that wouldn't change what is shown are not sent.
+// the emulator colour is current_colour. each text slot is the last text drawn at a position, it is valid until
+// something else is drawn over it. elided commands are counted in the jni statistics (e.g. TEXTXY_ELIDED)
+#define TEXT_SLOTS 32
+struct TextSlot {
+    bool valid;
+    int x, y, size;
+    int w, h; // area covered in pixels
+    char text[RING_TEXT_SIZE];
+    char colour[LINE_SIZE];
+} text_slots[TEXT_SLOTS];
+int text_slot_next = 0; // slot to replace when a new position is drawn
+bool display_cleared = false; // nothing has been drawn since the last CLEAR_DISPLAY
+char cleared_colour[LINE_SIZE]; // colour in effect at the last CLEAR_DISPLAY
+
+#define COMMAND_RING_CAPACITY 256
+CommandRing *command_ring = NULL;
+pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER; // the ring has a single producer so writers take turns
+
+// string command opcodes that have an equivalent binary ring opcode
+struct RingOpcodeName {
+    const char *name;
+    int opcode;
+} const ring_opcode_names[] = {
+        {"CLEAR_DISPLAY", RING_CLEAR_DISPLAY}, {"CLEAR_AREA", RING_CLEAR_AREA}, {"LINE", RING_LINE},
+        {"PIXEL", RING_PIXEL}, {"TEXTXY", RING_TEXTXY}, {"COLOUR", RING_COLOUR},
+        {"MOTOR_STEP", RING_MOTOR_STEP}, {"FOOD", RING_FOOD}, {"MESSAGE", RING_MESSAGE},
+        {"FILL_RECT", RING_FILL_RECT}, {"INVERT_AREA", RING_INVERT_AREA}, {"BITMAP", RING_BITMAP}
+};
+
+// bitmaps are sent as hex digits in bands of rows that fit in a command line or a ring record
+#define BITMAP_BAND_BYTES 48
+
+// button events pushed by the emulator through the native FishFeederEmulator.buttonEvent(int) method
+#define BUTTON_QUEUE_SIZE 16
+// poll interval when the emulator can't push button events. each poll is a call into java, so a wait polls
+// no more often than the menu loop used to (BUTTON_POLL_MS) and a long wait polls once per BUTTON_POLL_MAX_MS
+#define BUTTON_POLL_MS 100L
+#define BUTTON_POLL_MAX_MS 1000L
+struct ButtonQueueItem {
+    enum ButtonEvent event;
+    long long time; // monotonic milliseconds when the press happened
+} button_queue[BUTTON_QUEUE_SIZE];
+int button_queue_head = 0; // next item to read
+int button_queue_count = 0;
+bool button_events_pushed = false; // true once the native method is registered
+pthread_mutex_t button_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t button_cond = PTHREAD_COND_INITIALIZER;
+
+// asynchronous mode (see jniAsync()). commands that don't return a result are formatted as
+// frame command lines, queued and sent by a worker thread so the C processing thread doesn't wait for java
+#define ASYNC_QUEUE_SIZE 16
+struct AsyncItem {
+    char text[FRAME_BUFFER_SIZE]; // one or more command lines
+    bool as_frame; // send with a single frame() call if possible
+} async_queue[ASYNC_QUEUE_SIZE];
+int async_head = 0; // next item for the worker
+int async_count = 0;
+unsigned long async_submitted = 0; // total items queued
+unsigned long async_completed = 0; // total items sent
+atomic_bool async_enabled = false; // set by jniAsync() outside async_mutex, read by any sending thread
+bool async_worker_started = false;
+pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t async_work_cond = PTHREAD_COND_INITIALIZER; // signalled when an item is queued
+pthread_cond_t async_done_cond = PTHREAD_COND_INITIALIZER; // signalled when an item has been sent
+
+pthread_mutex_t intern_mutex = PTHREAD_MUTEX_INITIALIZER; // interned strings are shared by all jni threads
+
 #define stringify(x) #x
 #define stringify2(x) stringify(x)
 
@@ -154,7 +361,7 @@ void exception_check(JNIEnv *env, const char *msg) {
  * @param msec
  * @return 0 if successful, -1 if unsuccessful
  */
-int msleep(long msec) {
+int sleep_ms(long msec) {
     struct timespec ts;
     int res;
 
@@ -166,6 +373,30 @@ int msleep(long msec) {
     return res;
 }
 
+/**
+ * @return milliseconds from an arbitrary fixed point, unaffected by changes to the system clock
+ */
+long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * calculate an absolute real time deadline for pthread_cond_timedwait()
+ * @param deadline - receives the deadline
+ * @param msec - milliseconds from now
+ */
+void deadline_after(struct timespec *deadline, long msec) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += msec / 1000;
+    deadline->tv_nsec += (msec % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
 /**
  * add our current C thread 'number' to a string.
  * the pthread_t thread id is an opaque type, so we can't print it directly
@@ -176,15 +407,72 @@ int msleep(long msec) {
  * @return returns the number of characters added to the string
  */
 size_t threadId(char *sb, size_t position) {
-    pthread_t self = pthread_self();
+    if (thread_number < 0) {
+        thread_number = atomic_fetch_add(&thread_numbers, 1);
+    }
+
+    position += snprintf(sb+position, 20, "[Thread %2dC] ", thread_number);
+
+    return position;
+}
+
+/**
+ * thread exit destructor for detach_key. detaches a thread that was attached by attachCurrentThread()
+ * @param value - not used (must be non NULL for the destructor to run)
+ */
+void detach_thread(void *value) {
+    (void)value;
+    (*vm)->DetachCurrentThread(vm);
+}
+
+/**
+ * create the key used to detach threads from the JVM when they exit
+ */
+void create_detach_key() {
+    pthread_key_create(&detach_key, detach_thread);
+}
+
+/**
+ * get the java environment for the calling thread, attaching the thread to the JVM if needed.
+ * env_c is thread local so this is cheap once a thread has its environment.
+ * threads attached here are detached automatically when they exit.
+ * @return the JNIEnv for this thread
+ */
+JNIEnv *attachCurrentThread() {
+    if (env_c != NULL) {
+        return env_c;
+    }
+
+    // get the java environment for this thread note env_c is set by this call
+    int getEnvStat = (*vm)->GetEnv(vm, (void **) &env_c, JNI_VERSION_9); //TODO update JNI_VERSION_21
+    logAdd(JNI_MESSAGES, "got java environment");
 
-    for (int i = 0; i <= threadCount; i++) {
-        if (pthread_equal(threads[i], self)) {
-            position += snprintf(sb+position, 20, "[Thread %2dC] ", i);
+    // Attach this thread to the JVM
+    // https://docs.oracle.com/javase/8/docs/technotes/guides/jni/spec/invocation.html#AttachCurrentThread
+    // JNIEnv c. The JNI interface pointer (JNIEnv) is thread specific (only valid in the thread it was obtained in).
+    // Should another thread need to access the Java VM, it must first call AttachCurrentThread()
+    // to attach itself to the VM and obtain a JNI interface pointer.
+    // Once attached to the VM, a native thread works just like an ordinary Java thread running
+    // inside a native method. The native thread remains attached to the VM until it calls
+    // DetachCurrentThread() to detach itself.
+    if (getEnvStat == JNI_EDETACHED) {
+        logAdd(JNI_MESSAGES, "getEnv: not attached. Attaching...");
+        // as a daemon so that DestroyJavaVM() does not wait for C threads
+        if ((*vm)->AttachCurrentThreadAsDaemon(vm, (void **) &env_c, NULL) != 0) {
+            logAdd(JNI_MESSAGES, "C: Failed to attach thread to Java VM");
+            exit(1);
         }
+
+        // any non NULL value makes the key destructor run when the thread exits
+        pthread_once(&detach_key_once, create_detach_key);
+        pthread_setspecific(detach_key, vm);
+    } else if (getEnvStat == JNI_OK) {
+        logAdd(JNI_MESSAGES, "JNI already attached to thread");
+    } else if (getEnvStat == JNI_EVERSION) {
+        logAdd(JNI_MESSAGES, "getEnv: version not supported");
     }
 
-    return position;
+    return env_c;
 }
 /**
  *
@@ -193,16 +481,49 @@ size_t threadId(char *sb, size_t position) {
 bool isJavaFXReady(){
     char sb[LINE_SIZE];
 
+    // no need to ask if the emulator has told us
+    pthread_mutex_lock(&lifecycle_mutex);
+    bool ready = gui_ready;
+    pthread_mutex_unlock(&lifecycle_mutex);
+    if (ready) return true;
+
     snprintf(sb, LINE_SIZE, "calling %s.%s()", jclass_name_FishFeederEmulator, jmethod_name_isGUIReady);
     logAdd(JNI_MESSAGES,sb);
 
     // call the java method
+    attachCurrentThread();
     jboolean result = (*env_c)->CallStaticBooleanMethod(env_c, jclass_FishFeederEmulator, jmethod_isGUIReady, NULL);
     exception_check(env_c, jmethod_name_isGUIReady);
 
     return (bool)result;
 }
 
+/**
+ * wait for the JavaFX GUI to be ready, woken early by the native guiReady() method if the emulator calls it
+ * @return false if the GUI was not ready within GUI_READY_TIMEOUT_MS
+ */
+bool waitForJavaFX() {
+    long long end = monotonic_ms() + GUI_READY_TIMEOUT_MS;
+    struct timespec deadline;
+
+    while (!isJavaFXReady()) {
+        if (monotonic_ms() >= end) {
+            return false;
+        }
+        logAdd(JFX_MESSAGES, "JavaFX is not ready");
+
+        // give the GUI thread time to do something!
+        deadline_after(&deadline, GUI_READY_POLL_MS);
+        pthread_mutex_lock(&lifecycle_mutex);
+        if (!gui_ready) {
+            pthread_cond_timedwait(&lifecycle_cond, &lifecycle_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&lifecycle_mutex);
+    }
+
+    return true;
+}
+
 /**
  * create a new thread (creating a new env_c java thread environment)
  * to run the users C code with an entry point of userProcessing()
@@ -219,44 +540,48 @@ void* createThread(void * vargp) {
     //sleep(FX_START_DELAY);
 
     // get the java environment for the C processing thread note env_c is set by this call
-    int getEnvStat = (*vm)->GetEnv(vm, (void **) &env_c, JNI_VERSION_9); //TODO update JNI_VERSION_21
-    logAdd(JNI_MESSAGES, "got java environment");
-
-    // Attach this thread to the JVM
-    // https://docs.oracle.com/javase/8/docs/technotes/guides/jni/spec/invocation.html#AttachCurrentThread
-    // JNIEnv c. The JNI interface pointer (JNIEnv) is thread specific (only valid in the thread it was obtained in).
-    // Should another thread need to access the Java VM, it must first call AttachCurrentThread()
-    // to attach itself to the VM and obtain a JNI interface pointer.
-    // Once attached to the VM, a native thread works just like an ordinary Java thread running
-    // inside a native method. The native thread remains attached to the VM until it calls
-    // DetachCurrentThread() to detach itself.
-    if (getEnvStat == JNI_EDETACHED) {
-        logAdd(JNI_MESSAGES, "getEnv: not attached. Attaching...");
-        if ((*vm)->AttachCurrentThread(vm, (void **) &env_c, NULL) != 0) {
-            logAdd(JNI_MESSAGES, "processing thread. C: Failed to attach to Java VM");
-            exit(1);
-        }
-    } else if (getEnvStat == JNI_OK) {
-        logAdd(JNI_MESSAGES, "JNI already attached to thread");
-    } else if (getEnvStat == JNI_EVERSION) {
-        logAdd(JNI_MESSAGES, "getEnv: version not supported");
-    }
+    attachCurrentThread();
 
     // hand over to do the users processing.
     // This function should not return until the user code is done with the JFX GUI.
     logAdd(JNI_MESSAGES, "start userProcessing()");
 
     // wait for JavaFX to be ready.
-    // TODO this simple code could hang so might need a timeout
-    while (!isJavaFXReady()) {
-        logAdd(JFX_MESSAGES, "JavaFX is not ready");
-        msleep(50L); // give the GUI thread time to do something!
+    if (!waitForJavaFX()) {
+        logAdd(JFX_MESSAGES, "JavaFX did not start in time");
+        exit(1);
+    }
+    snprintf(sb, LINE_SIZE, "GUI ready %lld ms after jvm start", monotonic_ms() - jvm_start_ms);
+    logAdd(GENERAL, sb);
+
+    // the users preparation has usually finished by now
+    if (prepare_started) {
+        pthread_join(prepare_thread, NULL);
+        snprintf(sb, LINE_SIZE, "preparation finished %lld ms after startup", monotonic_ms() - startup_ms);
+        logAdd(GENERAL, sb);
     }
 
     // call the application (GUI users code, should not return until the application is finished)
     userProcessing();
     logAdd(JNI_MESSAGES, "returned from userProcessing()... finishing");
 
+    // make sure any queued commands reach the GUI
+    jniFence();
+
+    // if the JavaFX thread is waiting in javaFx() it finishes the application
+    // and this thread detaches from the JVM as it exits
+    pthread_mutex_lock(&lifecycle_mutex);
+    shutdown_requested = true;
+    bool handover = gui_thread_waiting;
+    pthread_cond_broadcast(&lifecycle_cond);
+    pthread_mutex_unlock(&lifecycle_mutex);
+
+    if (handover) {
+        logAdd(METHOD_ENTRY, "createThread(). Done");
+        return NULL;
+    }
+
+    // otherwise the JavaFX thread is still running the GUI (normal on *nix platforms).
     // tell the JFX to exit the process. This will also exit this C processing thread.
     // it is a little ugly but Platform.exit can't detach when the calling thread is the main thread
     // doing it this way also ensures that the C threads are killed when the JFX GUI is closed
@@ -297,6 +622,30 @@ jmethodID getJavaMethodReference(jclass class, char const * const className,
     return method;
 }
 
+/**
+ * get a java method reference that older versions of the emulator may not provide
+ * using the env_fx thread environment
+ * @param class - the java class reference containing the method
+ * @param className - the name of the class (used only for log messages)
+ * @param methodName - the name of the method we are looking for
+ * @param methodSig - the jvm textual method signature
+ * @return - the jmethodID reference to the method or NULL if the method does not exist
+ */
+jmethodID getOptionalJavaMethodReference(jclass class, char const * const className,
+                                         char const * const methodName, char const * const methodSig){
+    char sb[LINE_SIZE]; // string buffer for messages
+
+    jmethodID method = (*env_fx)->GetStaticMethodID(env_fx, class, methodName, methodSig);
+
+    if (method == NULL) {
+        // a missing method raises NoSuchMethodError which must be cleared before using the jni again
+        (*env_fx)->ExceptionClear(env_fx);
+        snprintf(sb, LINE_SIZE, "java %s.%s() not available", className, methodName);
+        logAdd(JNI_MESSAGES, sb);
+    }
+    return method;
+}
+
 /**
  * get a java class reference using the env_fx thread environment
  * @param class_name
@@ -317,6 +666,251 @@ jclass getJavaClassReference(char const * const class_name) {
     return (*env_fx)->NewGlobalRef(env_fx, class);
 }
 
+/**
+ * create the binary command ring and hand it to the emulator as a direct byte buffer
+ * using the env_fx thread environment.
+ * commands are sent as strings if the ring can't be created
+ */
+void attachCommandRing() {
+    char sb[LINE_SIZE]; // string buffer for messages
+
+    CommandRing *ring = ringCreate(COMMAND_RING_CAPACITY);
+    if (ring == NULL) {
+        logAdd(JNI_MESSAGES, "failed to allocate the command ring");
+        return;
+    }
+
+    jobject buffer = (*env_fx)->NewDirectByteBuffer(env_fx, ring, (jlong)ringSize(ring));
+    if (buffer == NULL) {
+        (*env_fx)->ExceptionClear(env_fx);
+        logAdd(JNI_MESSAGES, "direct byte buffers not supported, command ring not used");
+        ringDestroy(ring);
+        return;
+    }
+
+    (*env_fx)->CallStaticVoidMethod(env_fx, jclass_FishFeederEmulator, jmethod_attach_ring, buffer);
+    exception_check(env_fx, jmethod_name_attach_ring);
+    (*env_fx)->DeleteLocalRef(env_fx, buffer);
+
+    command_ring = ring;
+    snprintf(sb, LINE_SIZE, "command ring of %d records attached", ring->capacity);
+    logAdd(JNI_MESSAGES, sb);
+}
+
+/**
+ * create a global reference to a direct ByteBuffer using the env_fx thread environment
+ * @param memory
+ * @param size
+ * @return NULL if direct buffers aren't supported
+ */
+jobject direct_buffer(void *memory, size_t size) {
+    jobject buffer = (*env_fx)->NewDirectByteBuffer(env_fx, memory, (jlong)size);
+    if (buffer == NULL) {
+        (*env_fx)->ExceptionClear(env_fx);
+        return NULL;
+    }
+
+    jobject global = (*env_fx)->NewGlobalRef(env_fx, buffer);
+    (*env_fx)->DeleteLocalRef(env_fx, buffer);
+    return global;
+}
+
+/**
+ * wrap the framebuffer (or the dirty region buffer) in a direct ByteBuffer for
+ * FishFeederEmulator.displayUpdate() or displayFrame(). the display commands are used if this fails
+ */
+void attachDisplayFrame() {
+    if (jmethod_display_update != NULL) {
+        display_update_buffer = direct_buffer(display_update, FB_UPDATE_SIZE);
+    }
+    if (display_update_buffer == NULL && jmethod_display_frame != NULL) {
+        display_frame_buffer = direct_buffer(display_buffer.pages, FB_SIZE);
+    }
+
+    display_uploads = display_update_buffer != NULL || display_frame_buffer != NULL;
+    if (!display_uploads) {
+        logAdd(JNI_MESSAGES, "direct byte buffers not supported, sending display commands");
+    } else {
+        logAdd(JNI_MESSAGES, display_update_buffer != NULL ? "framebuffer attached, changed regions are uploaded"
+                                                           : "framebuffer attached, display frames are uploaded");
+    }
+}
+
+/**
+ * native method called by the emulator (in a java thread) when the button is pressed.
+ * the press is added to the button event queue, dropping the oldest press if the queue is full
+ * @param env
+ * @param class
+ * @param event - 1 short press, 2 long press
+ */
+JNIEXPORT void JNICALL native_button_event(JNIEnv *env, jclass class, jint event) {
+    (void)env;
+    (void)class;
+    if (event != ShortPress && event != LongPress) return;
+
+    pthread_mutex_lock(&button_mutex);
+    if (button_queue_count == BUTTON_QUEUE_SIZE) {
+        button_queue_head = (button_queue_head + 1) % BUTTON_QUEUE_SIZE;
+        button_queue_count--;
+    }
+    struct ButtonQueueItem *item = &button_queue[(button_queue_head + button_queue_count) % BUTTON_QUEUE_SIZE];
+    item->event = (enum ButtonEvent)event;
+    item->time = monotonic_ms();
+    button_queue_count++;
+    pthread_cond_signal(&button_cond);
+    pthread_mutex_unlock(&button_mutex);
+}
+
+/**
+ * native method called by the emulator (in a java thread) once the GUI is initialised.
+ * wakes the C processing thread waiting in waitForJavaFX()
+ * @param env
+ * @param class
+ */
+JNIEXPORT void JNICALL native_gui_ready(JNIEnv *env, jclass class) {
+    (void)env;
+    (void)class;
+    pthread_mutex_lock(&lifecycle_mutex);
+    gui_ready = true;
+    pthread_cond_broadcast(&lifecycle_cond);
+    pthread_mutex_unlock(&lifecycle_mutex);
+}
+
+/**
+ * register a native method with the emulator using the env_fx thread environment
+ * @param name - java method name
+ * @param signature - jvm textual method signature
+ * @param function - the C implementation
+ * @return false if the emulator does not declare the native method
+ */
+bool registerNativeMethod(char const * const name, char const * const signature, void *function) {
+    char sb[LINE_SIZE]; // string buffer for messages
+    JNINativeMethod method = {(char *) name, (char *) signature, function};
+
+    if ((*env_fx)->RegisterNatives(env_fx, jclass_FishFeederEmulator, &method, 1) != JNI_OK) {
+        (*env_fx)->ExceptionClear(env_fx);
+        snprintf(sb, LINE_SIZE, "native %s.%s() not supported", jclass_name_FishFeederEmulator, name);
+        logAdd(JNI_MESSAGES, sb);
+        return false;
+    }
+
+    snprintf(sb, LINE_SIZE, "native %s.%s() registered", jclass_name_FishFeederEmulator, name);
+    logAdd(JNI_MESSAGES, sb);
+    return true;
+}
+
+/**
+ * split option text in place and add each option to jvm_options
+ * @param text - options separated by spaces, or by lines if from a file
+ * @param from_file - true if the text is the content of the options file
+ * @param count - number of options already in jvm_options
+ * @return the new number of options
+ */
+int split_jvm_options(char *text, bool from_file, int count) {
+    char *save = NULL;
+    char *option = strtok_r(text, from_file ? "\r\n" : " \t\r\n", &save);
+
+    while (option != NULL) {
+        // trim leading space from file lines and ignore blank and comment lines
+        while (*option == ' ' || *option == '\t') option++;
+        if (from_file) {
+            char *end = option + strlen(option);
+            while (end > option && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+        }
+
+        if (*option != '\0' && *option != '#') {
+            if (count == MAX_JVM_OPTIONS - 1) { // keep a space for the class data sharing archive
+                logAdd(JNI_MESSAGES, "too many JVM options, ignoring the rest");
+                break;
+            }
+            jvm_options[count].optionString = option;
+            jvm_options[count].extraInfo = NULL;
+            count++;
+        }
+        option = strtok_r(NULL, from_file ? "\r\n" : " \t\r\n", &save);
+    }
+
+    return count;
+}
+
+/**
+ * build the JVM option list from the JVM_OPTIONS_ENV environment variable or the JVM_OPTIONS_FILE file.
+ * the class data sharing archive is added if it exists and the options don't select one already.
+ * @return the number of options in jvm_options
+ */
+int loadJvmOptions() {
+    char sb[LINE_SIZE]; // string buffer for messages
+    int count = 0;
+    bool cds_selected = false;
+
+    // the emulator module is always needed
+    jvm_options[count].optionString = "-Djdk.module.main=nns.fishfeedergui";
+    jvm_options[count].extraInfo = NULL;
+    count++;
+
+    char *env_options = getenv(JVM_OPTIONS_ENV);
+    if (env_options != NULL) {
+        snprintf(jvm_options_text, JVM_OPTIONS_TEXT_SIZE, "%s", env_options);
+        count = split_jvm_options(jvm_options_text, false, count);
+    } else {
+        FILE *file = fopen(JVM_OPTIONS_FILE, "r");
+        if (file != NULL) {
+            size_t length = fread(jvm_options_text, 1, JVM_OPTIONS_TEXT_SIZE - 1, file);
+            jvm_options_text[length] = '\0';
+            fclose(file);
+            count = split_jvm_options(jvm_options_text, true, count);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strncmp(jvm_options[i].optionString, "-XX:SharedArchiveFile", 21) == 0 ||
+            strncmp(jvm_options[i].optionString, "-Xshare", 7) == 0) {
+            cds_selected = true;
+        }
+    }
+
+    // use the archive from the appcds build target if there is one. if the archive doesn't
+    // match the runtime the JVM silently ignores it (default -Xshare:auto)
+    FILE *archive = fopen(JVM_CDS_ARCHIVE, "rb");
+    if (archive != NULL) {
+        fclose(archive);
+        if (!cds_selected) {
+            snprintf(jvm_cds_option, LINE_SIZE, "-XX:SharedArchiveFile=%s", JVM_CDS_ARCHIVE);
+            jvm_options[count].optionString = jvm_cds_option;
+            jvm_options[count].extraInfo = NULL;
+            count++;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        snprintf(sb, LINE_SIZE, "JVM option: %s", jvm_options[i].optionString);
+        logAdd(JNI_MESSAGES, sb);
+    }
+
+    return count;
+}
+
+/**
+ * thread entry point for the users preparation function
+ * @param vargp - not used
+ * @return NULL
+ */
+void* prepareThread(void * vargp) {
+    (void)vargp;
+    logAdd(METHOD_ENTRY, "prepareThread(). preparation starting");
+    prepare_function();
+    logAdd(METHOD_ENTRY, "prepareThread(). Done");
+    return NULL;
+}
+
+/**
+ * set a function to run in parallel with the JVM and JavaFX GUI starting
+ * @param prepare - the preparation function, NULL for none
+ */
+void jniPrepare(void (*prepare)()) {
+    prepare_function = prepare;
+}
+
 /**
  * setup the JNI environment
  * this locates the Java classes and methods required for the C processing thread
@@ -324,29 +918,43 @@ jclass getJavaClassReference(char const * const class_name) {
  */
 int jniSetup() {
 
-    // store the main thread id for debugging
-    threads[threadCount] = pthread_self(); // store the main thread id
-
+    char sb[LINE_SIZE]; // string buffer for messages
     logAdd(METHOD_ENTRY, "jniSetup(). Start JVM for nns.fishfeedergui");
+    startup_ms = monotonic_ms();
+
+#ifdef SIGUSR1
+    // kill -USR1 <pid> writes the jni call statistics
+    statsDumpOnSignal(SIGUSR1);
+#endif
+    ssdInit(&display_ssd, SSD_BUS_HZ);
+
+    // start the users preparation first so that it overlaps the JVM and GUI starting
+    if (prepare_function != NULL) {
+        prepare_started = pthread_create(&prepare_thread, NULL, prepareThread, NULL) == 0;
+        if (!prepare_started) {
+            prepare_function(); // no thread, prepare now instead
+        }
+    }
 
     // set up the JVM arguments
     JavaVMInitArgs vm_args;
     vm_args.version = JNI_VERSION_9; // at least java 1.9
-    JavaVMOption options[1];
-    options[0].optionString = "-Djdk.module.main=nns.fishfeedergui";
-    vm_args.options = options;
-    vm_args.nOptions = 1;
+    vm_args.options = jvm_options;
+    vm_args.nOptions = loadJvmOptions();
     vm_args.ignoreUnrecognized = JNI_FALSE;
 
     // Create (and attach to) the JVM. note env_fx is set by this call
     // https://docs.oracle.com/javase/8/docs/technotes/guides/jni/spec/invocation.html#creating_the_vm
+    jvm_start_ms = monotonic_ms();
     jint jvm_success = JNI_CreateJavaVM(&vm, (void **) &env_fx, &vm_args);
 
     if (jvm_success != JNI_OK) {
-        logAdd(JNI_MESSAGES, "Failed to create Java VM");
+        snprintf(sb, LINE_SIZE, "Failed to create Java VM. check the %s options", JVM_OPTIONS_ENV " or " JVM_OPTIONS_FILE);
+        logAdd(GENERAL, sb);
         return 1;
     }
-    logAdd(JNI_MESSAGES,"jvm successfully started");
+    snprintf(sb, LINE_SIZE, "jvm started in %lld ms", monotonic_ms() - jvm_start_ms);
+    logAdd(GENERAL, sb);
 
     // create a java global reference for the FishFeederEmulator class
     // note if we convert a jobject or jclass to a global reference they are valid in any thread (i.e. not only env_fx).
@@ -368,6 +976,12 @@ int jniSetup() {
     jmethod_message = getJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
                                              jmethod_name_message, jmethod_sig_message);
 
+    // get the typed clock method references. the clock is read with message() if the emulator doesn't have them
+    jmethod_rtc = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                 jmethod_name_rtc, jmethod_sig_rtc);
+    jmethod_rtc_warm_start = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                            jmethod_name_rtc_warm_start, jmethod_sig_rtc_warm_start);
+
     // get the Platform.exit() method reference
     jmethod_platform_exit = getJavaMethodReference(jclass_Platform, jclass_name_Platform,
                                                    jmethod_name_platform_exit, jmethod_sig_platform_exit);
@@ -380,10 +994,34 @@ int jniSetup() {
     jmethod_isGUIReady = getJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
                                                 jmethod_name_isGUIReady, jmethod_sig_isGUIReady);
 
+    // find the FishFeederEmulator.frame() method if the emulator supports batched display commands
+    jmethod_frame = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                   jmethod_name_frame, jmethod_sig_frame);
+
+    // let the emulator push button presses and GUI readiness to us. otherwise they are polled
+    button_events_pushed = registerNativeMethod(jnative_name_button_event, jnative_sig_button_event,
+                                                (void *) native_button_event);
+    registerNativeMethod(jnative_name_gui_ready, jnative_sig_gui_ready, (void *) native_gui_ready);
+
+    // upload changed regions or whole frames if the emulator can display the framebuffer
+    jmethod_display_update = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                            jmethod_name_display_update, jmethod_sig_display_update);
+    jmethod_display_frame = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                           jmethod_name_display_frame, jmethod_sig_display_frame);
+    if (jmethod_display_update != NULL || jmethod_display_frame != NULL) {
+        attachDisplayFrame();
+    }
+
+    // share the binary command ring if the emulator can drain it
+    jmethod_attach_ring = getOptionalJavaMethodReference(jclass_FishFeederEmulator, jclass_name_FishFeederEmulator,
+                                                         jmethod_name_attach_ring, jmethod_sig_attach_ring);
+    if (jmethod_attach_ring != NULL) {
+        attachCommandRing();
+    }
+
     // Create a new thread to run the C application code
     // This thread will run the users C code with an entry point of userProcessing()
-    threadCount++; //next available pthread_t item space
-    pthread_create(&threads[threadCount], NULL, createThread, NULL); // thread_id, attr, function, function args
+    pthread_create(&c_thread, NULL, createThread, NULL); // thread_id, attr, function, function args
 
     logAdd(METHOD_ENTRY, "jniSetup(). Done");
     return 0;
@@ -400,146 +1038,1092 @@ int javaFx() {
     char sb[LINE_SIZE]; // string buffer for messages
     logAdd(METHOD_ENTRY, "javaFx()");
 
-    // get the main method reference.
-    jmethodID method_main = getJavaMethodReference(jclass_FishFeederEmulator,
-                                                   jclass_name_FishFeederEmulator,
-                                                   jmethod_name_main, jmethod_sig_main);
+    // get the main method reference.
+    jmethodID method_main = getJavaMethodReference(jclass_FishFeederEmulator,
+                                                   jclass_name_FishFeederEmulator,
+                                                   jmethod_name_main, jmethod_sig_main);
+
+    // Call the main java method with the log level as the parameter
+    snprintf(sb, LINE_SIZE, "calling %s.%s()", jclass_name_FishFeederEmulator, jmethod_name_main);
+    logAdd(JNI_MESSAGES,sb);
+
+    char *str = malloc(sizeof(char) * LINE_SIZE);
+    sprintf(str, "%d", log_level);
+    jstring jstr = (*env_fx)->NewStringUTF(env_fx, str);
+    jobjectArray args = (*env_fx)->NewObjectArray(env_fx, 1, jclass_String, jstr); // 1 item
+
+    (*env_fx)->CallStaticVoidMethod(env_fx, jclass_FishFeederEmulator, method_main, args);
+    exception_check(env_fx, jmethod_name_main);
+
+    // free java object memory
+    //(*env_c)->DeleteLocalRef(env_fx, jstr); //BUG!
+    //(*env_c)->DeleteLocalRef(env_fx, args);
+    (*env_fx)->DeleteLocalRef(env_fx, jstr);
+    (*env_fx)->DeleteLocalRef(env_fx, args);
+
+    free(str);
+
+    // will not normally get here (in *nix platforms) until the JavaFX windows close
+    // for windows we need to keep the thread alive, so wait (without using the processor)
+    // until userProcessing() has finished.
+    // we still rely on process exit() to terminate the application (all threads)
+    // this has the advantage that the entire process will exit regardless of
+    // whether the Java GUI or C thread dies/is killed and will save students from
+    // having lots of half dead processes hanging around when code fails.
+    pthread_mutex_lock(&lifecycle_mutex);
+    gui_thread_waiting = true;
+    while (!shutdown_requested) {
+        pthread_cond_wait(&lifecycle_cond, &lifecycle_mutex);
+    }
+    pthread_mutex_unlock(&lifecycle_mutex);
+
+    // the C processing thread detaches from the JVM as it finishes
+    pthread_join(c_thread, NULL);
+
+    // tell the JFX to exit the process
+    snprintf(sb, LINE_SIZE, "calling java method %s.%s()", jclass_name_FishFeederEmulator, jmethod_name_emulator_exit);
+    logAdd(JNI_MESSAGES, sb);
+    (*env_fx)->CallStaticVoidMethod(env_fx, jclass_FishFeederEmulator, jmethod_exit, NULL);
+    exception_check(env_fx, jmethod_name_emulator_exit);
+
+    // only reached if the emulator did not end the process
+    (*env_fx)->CallStaticVoidMethod(env_fx, jclass_Platform, jmethod_platform_exit);
+    (*vm)->DestroyJavaVM(vm);
+    logAdd(METHOD_ENTRY, "javaFx() Done");
+    return 0;
+}
+
+/**
+ * find (or create) the interned global reference java string for a piece of text.
+ * opcodes such as "TEXTXY" and "RTC_SECOND" are sent on every call so are only converted once.
+ * @param text
+ * @return a global reference to the java string or NULL if the text can't be interned
+ */
+jstring intern_string(const char *text) {
+    jstring result = NULL;
+
+    pthread_mutex_lock(&intern_mutex);
+    for (int i = 0; i < intern_count && result == NULL; i++) {
+        if (strcmp(intern_table[i].text, text) == 0) {
+            result = intern_table[i].jstr;
+        }
+    }
+
+    if (result == NULL && intern_count < INTERN_TABLE_SIZE && strlen(text) < INTERN_TEXT_SIZE) {
+        jstring jstr = (*env_c)->NewStringUTF(env_c, text);
+        intern_table[intern_count].jstr = (*env_c)->NewGlobalRef(env_c, jstr);
+        (*env_c)->DeleteLocalRef(env_c, jstr);
+        strcpy(intern_table[intern_count].text, text);
+        result = intern_table[intern_count++].jstr;
+    }
+    pthread_mutex_unlock(&intern_mutex);
+
+    return result;
+}
+
+/**
+ * find (or create) the interned java string for a small number (pixel coordinates, sizes etc.)
+ * @param value
+ * @return a global reference to the java string or NULL if the number is not cached
+ */
+jstring intern_number(int value) {
+    char str[12];
+
+    if (value < 0 || value >= NUMBER_CACHE_SIZE) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&intern_mutex);
+    if (jstr_numbers[value] == NULL) {
+        fmtInt(str, sizeof(str), value);
+        jstring jstr = (*env_c)->NewStringUTF(env_c, str);
+        jstr_numbers[value] = (*env_c)->NewGlobalRef(env_c, jstr);
+        (*env_c)->DeleteLocalRef(env_c, jstr);
+    }
+    jstring result = jstr_numbers[value];
+    pthread_mutex_unlock(&intern_mutex);
+
+    return result;
+}
+
+/**
+ * a call into java has returned. record its time in the statistics and count the round trip
+ * @param opcode - for the latency statistics
+ * @param start - statsNow() before the call
+ */
+void jni_call_done(const char *opcode, long long start) {
+    statsRecord(opcode, statsNow() - start);
+    atomic_fetch_add(&count_jni_calls, 1);
+}
+
+/**
+ * copy a java string into a caller provided buffer without allocating memory
+ * the result is truncated if the buffer is too small
+ * @param jstr
+ * @param result - buffer for the c string
+ * @param size - size of the result buffer
+ */
+void decode_j_string(jstring jstr, char *result, size_t size) {
+    jsize length = (*env_c)->GetStringLength(env_c, jstr);
+    jsize utf_length = (*env_c)->GetStringUTFLength(env_c, jstr);
+
+    if ((size_t)utf_length < size) {
+        (*env_c)->GetStringUTFRegion(env_c, jstr, 0, length, result);
+        result[utf_length] = '\0';
+    } else {
+        // each java char can need up to 3 bytes of modified UTF-8
+        logAdd(JNI_MESSAGES, "decode_j_string() result truncated");
+        memset(result, 0, size);
+        (*env_c)->GetStringUTFRegion(env_c, jstr, 0, (jsize)((size - 1) / 3), result);
+    }
+}
+
+/**
+ * call the java command method with an array of strings argument provided.
+ * the caller is responsible for the jargs reference (normally released by a PopLocalFrame)
+ * @param opcode - the command name, for the latency statistics
+ * @param jargs
+ */
+void call_j_command (const char *opcode, jobjectArray jargs) {
+    logAdd(JNI_MESSAGES, "calling java command function");
+    long long start = statsNow();
+    (*env_c)->CallStaticVoidMethod(env_c, jclass_FishFeederEmulator, jmethod_command, jargs);
+    jni_call_done(opcode, start);
+    exception_check(env_c, jmethod_name_command);
+    logAdd(JNI_MESSAGES, "returned from java command function");
+}
+
+/**
+ * send a message to the JavaFX application and get a response
+ * @param opcode - the message name, for the latency statistics
+ * @param jargs
+ * @param result - buffer for the response message
+ * @param size - size of the result buffer
+ */
+void call_j_message(const char *opcode, jobjectArray jargs, char *result, size_t size) {
+    //logAdd(METHOD_ENTRY, "call_j_message()")
+
+    char sb[LINE_SIZE];
+    logAdd(JNI_MESSAGES, "calling java message function");
+    long long start = statsNow();
+    jstring jstr_result = (*env_c)->CallStaticObjectMethod(env_c, jclass_FishFeederEmulator, jmethod_message, jargs);
+    exception_check(env_c, jmethod_name_message);
+    logAdd(JNI_MESSAGES, "returned from java message function");
+
+    // get the result string straight into the callers buffer
+    decode_j_string(jstr_result, result, size);
+    (*env_c)->DeleteLocalRef(env_c, jstr_result);
+    jni_call_done(opcode, start);
+
+    if ((log_level & JNI_MESSAGES) > 0) {
+        snprintf(sb, LINE_SIZE, "result '%s'", result);
+        logAdd(JNI_MESSAGES, sb);
+    }
+
+    //logAdd(METHOD_ENTRY, "call_j_message() Done");
+}
+
+/**
+ * create a list of jni arguments from a set of parameters
+ * a format specifier must be used as the first parameter
+ * s character signifies a string argument in the respective position
+ * d character signifies a integer argument in the respective position
+ * f character signifies a floating point type argument in the respective position
+ * the first argument is the opcode and is interned, as are small integers.
+ * other arguments are local references so this should be called inside a jni local frame
+ * @param format
+ * @param args
+ * @return a jni jobjectArray
+ */
+jobjectArray build_args_list(char *format, va_list args) {
+    char str[LINE_SIZE]; // scratch buffer for number conversion
+
+    // convert the parameters into strings that will be passed to the java method as an array of strings
+    jstring jstrs = NULL;
+
+    // init jni parameter list
+    jobjectArray jargs = (*env_c)->NewObjectArray(env_c, (jsize)strlen(format), jclass_String, NULL);
+
+    // process each parameter
+    int count = 0;
+    while (*format != '\0') {
+        switch (*format++) {
+            case 's': {
+                const char *text = va_arg(args, const char *);
+                jstrs = (count == 0) ? intern_string(text) : NULL;
+                if (jstrs == NULL) {
+                    jstrs = (*env_c)->NewStringUTF(env_c, text);
+                }
+                break;
+            }
+            case 'd': {
+                int value = va_arg(args, int);
+                jstrs = intern_number(value);
+                if (jstrs == NULL) {
+                    fmtInt(str, LINE_SIZE, value);
+                    jstrs = (*env_c)->NewStringUTF(env_c, str);
+                }
+                break;
+            }
+            case 'l':
+                fmtLong(str, LINE_SIZE, va_arg(args, long));
+                jstrs = (*env_c)->NewStringUTF(env_c, str);
+                break;
+            case 'f':
+                snprintf(str, LINE_SIZE, "%f", va_arg(args, double));
+                jstrs = (*env_c)->NewStringUTF(env_c, str);
+                break;
+        }
+        // add the next jni parameter
+        (*env_c)->SetObjectArrayElement(env_c, jargs, count, jstrs);
+        count += 1;
+    }
+
+    return jargs;
+}
+
+/**
+ * create a list of jni arguments from a set of parameters
+ * the format specifier is the same as build_args_list()
+ * @param format
+ * @param ...
+ * @return a jni jobjectArray
+ */
+jobjectArray build_args(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    jobjectArray jargs = build_args_list(format, args);
+    va_end(args);
+
+    return jargs;
+}
+
+/**
+ * create a list of jni arguments from a recorded frame command line
+ * this should be called inside a jni local frame
+ * @param line - tab separated arguments (modified in place)
+ * @return a jni jobjectArray
+ */
+jobjectArray build_args_from_line(char *line) {
+    jsize count = 1;
+    for (char *c = line; *c != '\0'; c++) {
+        if (*c == '\t') count++;
+    }
+
+    jobjectArray jargs = (*env_c)->NewObjectArray(env_c, count, jclass_String, NULL);
+
+    for (jsize i = 0; i < count; i++) {
+        char *end = strchr(line, '\t');
+        if (end != NULL) *end = '\0';
+
+        jstring jstr = (i == 0) ? intern_string(line) : NULL;
+        if (jstr == NULL) {
+            jstr = (*env_c)->NewStringUTF(env_c, line);
+        }
+        (*env_c)->SetObjectArrayElement(env_c, jargs, i, jstr);
+
+        if (end != NULL) line = end + 1;
+    }
+
+    return jargs;
+}
+
+/**
+ * open a jni local frame so that all the local references created for a call
+ * are released together by PopLocalFrame()
+ */
+void push_local_frame() {
+    attachCurrentThread();
+    if ((*env_c)->PushLocalFrame(env_c, LOCAL_FRAME_CAPACITY) != 0) {
+        exception_check(env_c, "PushLocalFrame");
+    }
+}
+
+/**
+ * send a command to the JavaFX application
+ * @param format - build_args() format specifier
+ * @param args
+ */
+void j_command_list(char *format, va_list args) {
+    va_list opcode_args;
+    va_copy(opcode_args, args);
+    const char *opcode = (format[0] == 's') ? va_arg(opcode_args, const char *) : "COMMAND";
+    va_end(opcode_args);
+
+    push_local_frame();
+    call_j_command(opcode, build_args_list(format, args));
+    (*env_c)->PopLocalFrame(env_c, NULL);
+}
+
+/**
+ * send a command to the JavaFX application
+ * @param format - build_args() format specifier
+ * @param ...
+ */
+void j_command(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    j_command_list(format, args);
+    va_end(args);
+}
+
+/**
+ * send a message to the JavaFX application and get the response.
+ * messages that are only an opcode (e.g. "BUTTON", "RTC_SECOND") reuse a cached argument array
+ * since the message method has finished with its arguments once it returns the result.
+ * @param result - buffer for the response message
+ * @param size - size of the result buffer
+ * @param format - build_args() format specifier
+ * @param ...
+ */
+void j_message(char *result, size_t size, char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    push_local_frame();
+
+    if (strcmp(format, "s") == 0) {
+        const char *opcode = va_arg(args, const char *);
+        jobjectArray jargs = NULL;
+        int i = 0;
+
+        pthread_mutex_lock(&message_args_mutex);
+        while (i < message_args_count && strcmp(message_args[i].text, opcode) != 0) {
+            i++;
+        }
+
+        jstring jopcode = (i == message_args_count) ? intern_string(opcode) : NULL;
+
+        if (jopcode != NULL && i < INTERN_TABLE_SIZE) {
+            jobjectArray new_args = (*env_c)->NewObjectArray(env_c, 1, jclass_String, jopcode);
+            message_args[i].jargs = (*env_c)->NewGlobalRef(env_c, new_args);
+            strcpy(message_args[i].text, opcode);
+            message_args_count++;
+        }
+
+        if (i < message_args_count) {
+            jargs = message_args[i].jargs;
+        }
+        pthread_mutex_unlock(&message_args_mutex);
+
+        // the cached array is only read by java, so it can be used by several threads at once
+        call_j_message(opcode, jargs != NULL ? jargs : build_args("s", opcode), result, size);
+    } else {
+        va_list opcode_args;
+        va_copy(opcode_args, args);
+        const char *opcode = (format[0] == 's') ? va_arg(opcode_args, const char *) : "MESSAGE";
+        va_end(opcode_args);
+
+        call_j_message(opcode, build_args_list(format, args), result, size);
+    }
+
+    (*env_c)->PopLocalFrame(env_c, NULL);
+    va_end(args);
+}
+
+/**
+ * send command lines to the JavaFX application
+ * a single FishFeederEmulator.frame() call is used if requested and the emulator provides it,
+ * otherwise the commands are sent one at a time
+ * @param text - command lines, each a tab separated list of arguments ending in a newline (modified)
+ * @param as_frame
+ */
+void send_command_lines(char *text, bool as_frame) {
+    if (as_frame && jmethod_frame != NULL) {
+        attachCurrentThread();
+        jstring jframe = (*env_c)->NewStringUTF(env_c, text);
+        long long start = statsNow();
+        (*env_c)->CallStaticVoidMethod(env_c, jclass_FishFeederEmulator, jmethod_frame, jframe);
+        jni_call_done("FRAME", start);
+        exception_check(env_c, jmethod_name_frame);
+        (*env_c)->DeleteLocalRef(env_c, jframe);
+    } else {
+        char *line = text;
+        while (*line != '\0') {
+            char *end = strchr(line, '\n');
+            *end = '\0';
+            push_local_frame();
+            jobjectArray jargs = build_args_from_line(line); // leaves line as just the opcode
+            call_j_command(line, jargs);
+            (*env_c)->PopLocalFrame(env_c, NULL);
+            line = end + 1;
+        }
+    }
+}
+
+/**
+ * worker thread for asynchronous mode. attaches to the JVM and sends the queued commands in order
+ * @param vargp
+ * @return
+ */
+void* asyncWorker(void * vargp) {
+    (void)vargp;
+    logAdd(METHOD_ENTRY, "asyncWorker(). async JNI worker thread starting");
+
+    attachCurrentThread();
+
+    pthread_mutex_lock(&async_mutex);
+    while (true) {
+        while (async_count == 0) {
+            pthread_cond_wait(&async_work_cond, &async_mutex);
+        }
+
+        // the item can't be overwritten until async_count is reduced, so send it without holding the lock
+        struct AsyncItem *item = &async_queue[async_head];
+        pthread_mutex_unlock(&async_mutex);
+
+        send_command_lines(item->text, item->as_frame);
+
+        pthread_mutex_lock(&async_mutex);
+        async_head = (async_head + 1) % ASYNC_QUEUE_SIZE;
+        async_count--;
+        async_completed++;
+        pthread_cond_broadcast(&async_done_cond);
+    }
+}
+
+/**
+ * queue command lines for the async worker thread, waiting if the queue is full
+ * @param text - command lines
+ * @param length - length of text
+ * @param as_frame
+ */
+void async_submit(const char *text, size_t length, bool as_frame) {
+    pthread_mutex_lock(&async_mutex);
+    while (async_count == ASYNC_QUEUE_SIZE) {
+        pthread_cond_wait(&async_done_cond, &async_mutex);
+    }
+
+    struct AsyncItem *item = &async_queue[(async_head + async_count) % ASYNC_QUEUE_SIZE];
+    memcpy(item->text, text, length);
+    item->text[length] = '\0';
+    item->as_frame = as_frame;
+
+    async_count++;
+    async_submitted++;
+    pthread_cond_signal(&async_work_cond);
+    pthread_mutex_unlock(&async_mutex);
+}
+
+/**
+ * wait until every command queued so far in asynchronous mode has been sent to the JavaFX application
+ */
+void jniFence() {
+    pthread_mutex_lock(&async_mutex);
+    unsigned long target = async_submitted;
+    while (async_completed < target) {
+        pthread_cond_wait(&async_done_cond, &async_mutex);
+    }
+    pthread_mutex_unlock(&async_mutex);
+}
+
+/**
+ * turn asynchronous mode on or off.
+ * in asynchronous mode commands that don't return a result (display, motor, food, info) are queued
+ * and sent by a separate JNI thread, so the caller does not wait for the JavaFX application.
+ * turning it off waits for the queued commands to be sent.
+ * @param enable
+ */
+void jniAsync(bool enable) {
+    pthread_mutex_lock(&async_mutex);
+    if (enable && !async_worker_started) {
+        async_worker_started = true;
+        pthread_create(&async_thread, NULL, asyncWorker, NULL);
+    }
+    pthread_mutex_unlock(&async_mutex);
+
+    if (!enable) {
+        jniFence();
+    }
+
+    atomic_store(&async_enabled, enable);
+}
+
+/**
+ * running totals since startup, e.g. for a debug overlay (see fish_hud.h)
+ * @param counts - set to the frames shown, display commands and calls into java so far
+ */
+void jniCounts(JniCounts *counts) {
+    counts->frames = atomic_load(&count_frames);
+    counts->display_commands = atomic_load(&count_display_commands);
+    counts->jni_calls = atomic_load(&count_jni_calls);
+}
+
+/**
+ * write the jni call statistics for each opcode
+ * @param filename - file to write, NULL for the console
+ * @param json - JSON rather than a text table
+ */
+void jniStats(char *filename, bool json) {
+    char sb[LINE_SIZE]; // string buffer for messages
+
+    FILE *file = stdout;
+    if (filename != NULL) {
+        file = fopen(filename, "w");
+        if (file == NULL) {
+            snprintf(sb, LINE_SIZE, "jniStats() could not open %s", filename);
+            logAdd(GENERAL, sb);
+            return;
+        }
+    }
+
+    statsWrite(file, json);
+    if (!json) {
+        pthread_mutex_lock(&display_mutex);
+        ssdReport(&display_ssd, file);
+        pthread_mutex_unlock(&display_mutex);
+    }
+
+    if (file != stdout) {
+        fclose(file);
+    }
+}
+
+/**
+ * clear the jni call statistics
+ */
+void jniStatsReset() {
+    statsReset();
+}
+
+/**
+ * report the time from startup to the first display frame (once only)
+ */
+void first_frame() {
+    char sb[LINE_SIZE]; // string buffer for messages
+
+    if (atomic_load(&first_frame_sent) || atomic_exchange(&first_frame_sent, true)) return;
+    snprintf(sb, LINE_SIZE, "first frame %lld ms after startup", monotonic_ms() - startup_ms);
+    logAdd(GENERAL, sb);
+}
+
+/**
+ * a frame has been shown. send it to the display controller model to count the I2C traffic
+ * the real display would need for it. it is counted in jniCounts() if something was sent to the emulator for
+ * it or it changed the display, not for an empty or repeated frame
+ * @param sent - display commands or an upload were sent for the frame
+ */
+void frame_shown(bool sent) {
+    pthread_mutex_lock(&display_mutex);
+    long long bus_ns = ssdUpdate(&display_ssd, &display_buffer);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (sent || bus_ns > 0) {
+        atomic_fetch_add(&count_frames, 1);
+    }
+    if (bus_ns > 0) {
+        statsRecord("SSD1306_FRAME", bus_ns); // bus time, not call time
+    }
+    first_frame();
+}
+
+/**
+ * something has been drawn over an area of the display, so the text slots it overlaps are no longer valid.
+ * the caller holds display_mutex
+ * @param x - left
+ * @param y - top
+ * @param w - width
+ * @param h - height
+ */
+void shadow_drawn(int x, int y, int w, int h) {
+    display_cleared = false;
+
+    for (int i = 0; i < TEXT_SLOTS; i++) {
+        struct TextSlot *slot = &text_slots[i];
+        if (slot->valid && x < slot->x + slot->w && slot->x < x + w && y < slot->y + slot->h && slot->y < y + h) {
+            slot->valid = false;
+        }
+    }
+}
+
+/**
+ * check whether a text command would redraw the text already shown at the same position in the same colour,
+ * recording it in a text slot if not. the caller holds display_mutex
+ * @param x
+ * @param y
+ * @param text
+ * @param size
+ * @return true if the command isn't needed
+ */
+bool shadow_text(int x, int y, const char *text, int size) {
+    struct TextSlot *slot = NULL;
+
+    for (int i = 0; i < TEXT_SLOTS && slot == NULL; i++) {
+        if (text_slots[i].valid && text_slots[i].x == x && text_slots[i].y == y && text_slots[i].size == size) {
+            slot = &text_slots[i];
+        }
+    }
+
+    if (slot != NULL && strcmp(slot->text, text) == 0 && strcmp(slot->colour, current_colour) == 0) {
+        return true;
+    }
+
+    int w = (int)strlen(text) * FB_CHAR_WIDTH * size;
+    int h = FB_CHAR_HEIGHT * size;
+    shadow_drawn(x, y, w, h);
+
+    if (slot == NULL) {
+        slot = &text_slots[text_slot_next];
+        text_slot_next = (text_slot_next + 1) % TEXT_SLOTS;
+    }
+    slot->valid = strlen(text) < RING_TEXT_SIZE && strlen(current_colour) > 0;
+    slot->x = x;
+    slot->y = y;
+    slot->size = size;
+    slot->w = w;
+    slot->h = h;
+    snprintf(slot->text, RING_TEXT_SIZE, "%s", text);
+    strcpy(slot->colour, current_colour);
+
+    return false;
+}
+
+/**
+ * forget the last frame sent, the display has been changed some other way
+ */
+void forget_last_frame() {
+    pthread_mutex_lock(&display_mutex);
+    last_frame_length = 0;
+    pthread_mutex_unlock(&display_mutex);
+}
+
+/**
+ * check whether a complete frame is the same as the last frame sent, recording it as the last frame if not
+ * @return true if the frame doesn't need sending
+ */
+bool frame_unchanged() {
+    bool unchanged;
+
+    pthread_mutex_lock(&display_mutex);
+    unchanged = frame_length == last_frame_length && strcmp(frame_colour, last_frame_colour) == 0 &&
+                memcmp(frame_buffer, last_frame, frame_length) == 0;
+    if (unchanged) {
+        frames_unchanged++;
+        statsCount("FRAME_UNCHANGED");
+    } else {
+        memcpy(last_frame, frame_buffer, frame_length);
+        last_frame_length = frame_length;
+        strcpy(last_frame_colour, frame_colour);
+    }
+    pthread_mutex_unlock(&display_mutex);
+
+    return unchanged;
+}
+
+/**
+ * send all the display commands recorded in the frame buffer to the JavaFX application
+ * @param complete - false if the buffer is full and the frame is being sent in parts
+ * @return false if there was nothing to send or the frame was the same as the last one
+ */
+bool send_frame(bool complete) {
+    char sb[LINE_SIZE];
+
+    if (frame_commands == 0) return false;
+
+    // a repeated frame would draw exactly the same pixels again
+    if (complete && !frame_split && frame_unchanged()) {
+        logAdd(JNI_MESSAGES, "frame unchanged, not sent");
+        frame_length = 0;
+        frame_commands = 0;
+        return false; // the caller still reports the frame shown
+    }
+
+    if (!complete || frame_split) {
+        forget_last_frame();
+    }
+    frame_split = !complete;
+
+    snprintf(sb, LINE_SIZE, "sending frame of %d commands", frame_commands);
+    logAdd(JNI_MESSAGES, sb);
+
+    frame_buffer[frame_length] = '\0';
+
+    if (atomic_load(&async_enabled)) {
+        async_submit(frame_buffer, frame_length, true);
+    } else {
+        send_command_lines(frame_buffer, true);
+    }
+
+    frame_length = 0;
+    frame_commands = 0;
+    return true;
+}
+
+/**
+ * format a command as a line of tab separated arguments
+ * @param line - buffer of at least LINE_SIZE characters for the result
+ * @param format - build_args() format specifier
+ * @param args
+ * @return the length of the line including the terminating newline
+ */
+size_t format_command(char *line, char *format, va_list args) {
+    size_t length = 0;
+
+    while (*format != '\0' && length < LINE_SIZE - 1) {
+        if (length > 0) line[length++] = '\t';
+
+        switch (*format++) {
+            case 's': {
+                // tabs and newlines are the frame separators so can't appear in a text argument
+                const char *text = va_arg(args, const char *);
+                for (; *text != '\0' && length < LINE_SIZE - 1; text++) {
+                    line[length++] = (*text == '\t' || *text == '\n') ? ' ' : *text;
+                }
+                break;
+            }
+            case 'd':
+                length += fmtInt(line+length, LINE_SIZE-length, va_arg(args, int));
+                break;
+            case 'l':
+                length += fmtLong(line+length, LINE_SIZE-length, va_arg(args, long));
+                break;
+            case 'f':
+                length += snprintf(line+length, LINE_SIZE-length, "%f", va_arg(args, double));
+                break;
+        }
+        if (length > LINE_SIZE - 1) length = LINE_SIZE - 1; // snprintf truncated
+    }
+    line[length++] = '\n';
+
+    return length;
+}
+
+/**
+ * record a display command in the frame buffer as a line of tab separated arguments
+ * the frame is sent early if the buffer fills up
+ * @param format - build_args() format specifier
+ * @param args
+ */
+void record_command(char *format, va_list args) {
+    char line[LINE_SIZE];
+    size_t length = format_command(line, format, args);
+
+    // leave room for the terminating null added by send_frame()
+    if (frame_length + length >= FRAME_BUFFER_SIZE) {
+        send_frame(false);
+    }
+
+    memcpy(frame_buffer + frame_length, line, length);
+    frame_length += length;
+    frame_commands++;
+}
+
+/**
+ * send a command that has no result to the JavaFX application,
+ * queueing it for the worker thread in asynchronous mode
+ * @param format - build_args() format specifier
+ * @param args
+ */
+void send_command_list(char *format, va_list args) {
+    if (atomic_load(&async_enabled)) {
+        char line[LINE_SIZE];
+        size_t length = format_command(line, format, args);
+        async_submit(line, length, false);
+    } else {
+        j_command_list(format, args);
+    }
+}
+
+/**
+ * add a command to the binary command ring shared with the emulator
+ * @param format - build_args() format specifier. the first argument is the opcode
+ * @param args
+ * @return false if the command can't be sent through the ring (it must then be sent as strings)
+ */
+bool ring_command(char *format, va_list args) {
+    int ints[RING_MAX_ARGS];
+    int nargs = 0;
+    char text[RING_TEXT_SIZE];
+    size_t length = 0;
+    int opcode = 0;
+
+    if (command_ring == NULL || *format++ != 's') return false;
+
+    const char *name = va_arg(args, const char *);
+    for (size_t i = 0; i < sizeof(ring_opcode_names) / sizeof(ring_opcode_names[0]); i++) {
+        if (strcmp(ring_opcode_names[i].name, name) == 0) {
+            opcode = ring_opcode_names[i].opcode;
+        }
+    }
+    if (opcode == 0) return false;
+
+    while (*format != '\0') {
+        switch (*format++) {
+            case 'd':
+                if (nargs == RING_MAX_ARGS) return false;
+                ints[nargs++] = va_arg(args, int);
+                break;
+            case 's': {
+                // several strings are packed one after another with their null terminators
+                const char *str = va_arg(args, const char *);
+                size_t n = strlen(str) + 1;
+                if (length + n > RING_TEXT_SIZE) n = RING_TEXT_SIZE - length;
+                memcpy(text + length, str, n);
+                length += n;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    pthread_mutex_lock(&ring_mutex);
+    ringPush(command_ring, opcode, ints, nargs, text, length);
+    pthread_mutex_unlock(&ring_mutex);
+    return true;
+}
+
+/**
+ * send a (non display) command to the JavaFX application
+ * through the command ring if possible
+ * @param format - build_args() format specifier
+ * @param ...
+ */
+void emulator_command(char *format, ...) {
+    va_list args, ring_args;
+    va_start(args, format);
+    va_copy(ring_args, args);
+
+    if (!ring_command(format, ring_args)) {
+        send_command_list(format, args);
+    }
+
+    va_end(ring_args);
+    va_end(args);
+}
+
+/**
+ * upload the framebuffer to the JavaFX application if it has changed since the last upload.
+ * displayUpdate() is given the packed changed regions (see fbPackRegions()), otherwise
+ * displayFrame() is given the whole framebuffer.
+ * java must copy the data before returning since drawing continues straight away
+ */
+void present_frame() {
+    FbRegion regions[FB_PAGES];
+    char sb[LINE_SIZE];
+
+    attachCurrentThread();
+
+    pthread_mutex_lock(&display_mutex);
+    int count = fbPresent(&display_presenter, &display_buffer, regions);
+    if (count == 0) {
+        pthread_mutex_unlock(&display_mutex);
+        return;
+    }
 
-    // Call the main java method with the log level as the parameter
-    snprintf(sb, LINE_SIZE, "calling %s.%s()", jclass_name_FishFeederEmulator, jmethod_name_main);
-    logAdd(JNI_MESSAGES,sb);
+    long long start = statsNow();
+    if (display_update_buffer != NULL) {
+        size_t length = fbPackRegions(&display_buffer, regions, count, display_update);
+        (*env_c)->CallStaticVoidMethod(env_c, jclass_FishFeederEmulator, jmethod_display_update,
+                                       display_update_buffer, (jint)length);
+        jni_call_done("DISPLAY_UPDATE", start);
+        pthread_mutex_unlock(&display_mutex);
+        exception_check(env_c, jmethod_name_display_update);
+
+        if ((log_level & JNI_MESSAGES) > 0) {
+            snprintf(sb, LINE_SIZE, "display update of %d regions, %zu bytes", count, length);
+            logAdd(JNI_MESSAGES, sb);
+        }
+    } else {
+        (*env_c)->CallStaticVoidMethod(env_c, jclass_FishFeederEmulator, jmethod_display_frame, display_frame_buffer);
+        jni_call_done("DISPLAY_FRAME", start);
+        pthread_mutex_unlock(&display_mutex);
+        exception_check(env_c, jmethod_name_display_frame);
+    }
 
-    char *str = malloc(sizeof(char) * LINE_SIZE);
-    sprintf(str, "%d", log_level);
-    jstring jstr = (*env_fx)->NewStringUTF(env_fx, str);
-    jobjectArray args = (*env_fx)->NewObjectArray(env_fx, 1, jclass_String, jstr); // 1 item
+    frame_shown(true);
+}
 
-    (*env_fx)->CallStaticVoidMethod(env_fx, jclass_FishFeederEmulator, method_main, args);
-    exception_check(env_fx, jmethod_name_main);
+/**
+ * @return milliseconds until the pending frame may be presented, -1 if there is no pending frame
+ */
+long long frame_due_ms() {
+    if (!frame_pending) return -1;
+    if (display_fps <= 0) return 0;
 
-    // free java object memory
-    //(*env_c)->DeleteLocalRef(env_fx, jstr); //BUG!
-    //(*env_c)->DeleteLocalRef(env_fx, args);
-    (*env_fx)->DeleteLocalRef(env_fx, jstr);
-    (*env_fx)->DeleteLocalRef(env_fx, args);
+    long long due = frame_presented_ms + 1000 / display_fps - monotonic_ms();
+    return due < 0 ? 0 : due;
+}
 
-    // without the while will not normally get here (in *nix platforms) until the JavaFX windows close
-    // for windows we need to keep the thread alive...
-    // TODO hence we rely on process exit() to terminate the application (all threads)
-    // this has the advantage that the entire process will exit regardless of
-    // whether the Java GUI or C thread dies/is killed and will save students from
-    // having lots of half dead processes hanging around when code fails.
-    while(1){}
+/**
+ * present the frame(s) held back by the frame rate limit
+ */
+void present_pending_frame() {
+    frame_pending = false;
+    frame_presented_ms = monotonic_ms();
+
+    if (display_uploads) {
+        present_frame();
+    } else {
+        frame_shown(send_frame(true));
+    }
+}
 
-    //(*env_fx)->CallStaticVoidMethod(env_fx, jclass_Platform, jmethod_platform_exit, args);
-    //(*vm)->DetachCurrentThread(vm); // causes Toolkit not initialized exception
-    //(*vm)->DestroyJavaVM(vm);
-    //logAdd(METHOD_ENTRY, "javaFx() Done");
-    //return 0;
+/**
+ * present the pending frame if the frame rate limit allows it
+ */
+void present_due_frame() {
+    if (frame_due_ms() == 0) present_pending_frame();
 }
 
 /**
- * call the java command method with an array of strings argument provided.
- * @param jargs
+ * drop the commands of frames held back by the frame rate limit, the display is about to be cleared so they
+ * would never be seen. the colour in effect is recorded first so the emulator colour still ends up the same
  */
-void call_j_command (jobjectArray jargs) {
-    logAdd(JNI_MESSAGES, "calling java command function");
-    (*env_c)->CallStaticObjectMethod(env_c, jclass_FishFeederEmulator, jmethod_command, jargs);
-    exception_check(env_c, jmethod_name_command);
-    logAdd(JNI_MESSAGES, "returned from java command function");
+void discard_pending_frame() {
+    frame_length = 0;
+    frame_commands = 0;
+    frame_split = false;
+    statsCount("FRAME_DISCARDED");
+
+    pthread_mutex_lock(&display_mutex);
+    strcpy(frame_colour, current_colour);
+    if (strlen(current_colour) > 0) {
+        frame_length = snprintf(frame_buffer, FRAME_BUFFER_SIZE, "COLOUR\t%s\n", current_colour);
+        frame_commands = 1;
+    }
+    pthread_mutex_unlock(&display_mutex);
+}
+
+/**
+ * sleep for a number of milliseconds (posix sleep() is seconds)
+ * a frame held back by the frame rate limit is presented when it is due during the sleep
+ * @param msec
+ * @return 0 if successful, -1 if unsuccessful
+ */
+int msleep(long msec) {
+    long long due = frame_due_ms();
 
-    // release the local array reference
-    (*env_c)->DeleteLocalRef(env_c, jargs);
+    if (due >= 0 && due <= msec) {
+        sleep_ms(due);
+        present_pending_frame();
+        msec -= due;
+    }
+    return sleep_ms(msec);
 }
 
 /**
- * send a message to the JavaFX application and get a response
- * @param message
- * @return the response message - memory needs freeing by caller
+ * limit the rate frames are presented on the display. a frame ended too soon after the previous one is
+ * held back and combined with the following frames, so a fast redraw loop (e.g. the display updated
+ * after every motor step) only shows its latest state. only applies to frames (see displayBeginFrame())
+ * @param fps - maximum frames per second, 0 for no limit
  */
-char *call_j_message(jobjectArray jargs) {
-    //logAdd(METHOD_ENTRY, "call_j_message()")
+void displayFrameRate(int fps) {
+    display_fps = fps < 0 ? 0 : fps;
+}
 
+/**
+ * turn the display on, dim it or turn it off
+ * turning it off clears the display (in the current frame if one is being drawn) and turns the panel off.
+ * then nothing is drawn, sent to the emulator or presented until it is turned on again, so an idle display
+ * costs nothing. it is blank when it is turned on and must be redrawn
+ * @param power
+ */
+void displayPower(enum DisplayPower power) {
     char sb[LINE_SIZE];
-    logAdd(JNI_MESSAGES, "calling java message function");
-    jstring jstr_result = (*env_c)->CallStaticObjectMethod(env_c, jclass_FishFeederEmulator, jmethod_message, jargs);
-    exception_check(env_c, jmethod_name_message);
-    logAdd(JNI_MESSAGES, "returned from java message function");
 
-    (*env_c)->DeleteLocalRef(env_c, jargs);
+    if (power == display_power) return;
 
-    // get the result string as a c string pointer from the java object
-    const char *cstr_result = (*env_c)->GetStringUTFChars(env_c, jstr_result, NULL);
+    if (power == DisplayOff) {
+        displayClear();
+        display_blanking = frame_depth > 0; // still to be sent by displayEndFrame()
+    }
+    display_power = power;
 
-    char *result = malloc(LINE_SIZE);
-    strcpy(result, cstr_result);
-    // release the java result string memory (must copy the string first if we want to keep it)
-    (*env_c)->ReleaseStringUTFChars(env_c, jstr_result, cstr_result);
+    pthread_mutex_lock(&display_mutex);
+    ssdPower(&display_ssd, power != DisplayOff, power == DisplayOn ? SSD_CONTRAST : SSD_CONTRAST_DIMMED);
+    pthread_mutex_unlock(&display_mutex);
 
-    snprintf(sb, LINE_SIZE, "result '%s'", result);
+    fmtText(sb, LINE_SIZE, "display %s", power == DisplayOn ? "on" : power == DisplayDimmed ? "dimmed" : "off");
     logAdd(JNI_MESSAGES, sb);
+}
 
-    //logAdd(METHOD_ENTRY, "call_j_message() Done");
-    return result;
+/**
+ * @return the display power set by displayPower()
+ */
+enum DisplayPower displayPowerState() {
+    return display_power;
 }
 
 /**
- * create a list of jni arguments from a set of parameters
- * a format specifier must be used as the first parameter
- * s character signifies a string argument in the respective position
- * d character signifies a integer argument in the respective position
- * f character signifies a floating point type argument in the respective position
- * @param format
+ * send a display command to the JavaFX application
+ * or record it if a frame is being built (see displayBeginFrame())
+ * @param format - build_args() format specifier
  * @param ...
- * @return a jni jobjectArray
  */
-jobjectArray build_args(char *format, ...) {
-    va_list args;
-    va_start(args, format);
+void display_command(char *format, ...) {
+    atomic_fetch_add(&count_display_commands, 1);
 
-    // convert the parameters into strings that will be passed to the java method as an array of strings
-    jstring jstrs;
+    // drawing outside a frame must not overtake a frame that is being held back
+    if (frame_depth == 0 && frame_pending) {
+        present_pending_frame();
+    }
 
-    // init jni parameter list
-    jstring init = (*env_c)->NewStringUTF(env_c, "");
-    jobjectArray jargs = (*env_c)->NewObjectArray(env_c, (jsize)strlen(format), jclass_String, init); // 3 items
+    // already drawn into the framebuffer, upload it unless a frame is being drawn
+    if (display_uploads) {
+        if (frame_depth == 0) present_frame();
+        return;
+    }
 
-    // process each parameter
-    char *str = malloc(sizeof(char) * LINE_SIZE);
-    int count = 0;
-    while (*format != '\0') {
-        switch (*format++) {
-            case 's':
-                sprintf(str, "%s", va_arg(args, const char *));
-                //fprintf(stdout, "string arg[%d]: %s\n", count, str);
-                jstrs = (*env_c)->NewStringUTF(env_c, str);
-                break;
-            case 'd':
-                sprintf(str, "%d", va_arg(args, int));
-                //fprintf(stdout, "string arg[%d]: %s\n", count, str);
-                jstrs = (*env_c)->NewStringUTF(env_c, str);
-                break;
-            case 'l':
-                sprintf(str, "%ld", va_arg(args, long));
-                //fprintf(stdout, "string arg[%d]: %s\n", count, str);
-                jstrs = (*env_c)->NewStringUTF(env_c, str);
-                break;
-            case 'f':
-                sprintf(str, "%f", va_arg(args, double));
-                //fprintf(stdout, "string arg[%d]: %s\n", count, str);
-                jstrs = (*env_c)->NewStringUTF(env_c, str);
-                break;
-        }
-        // add the next jni parameter
-        (*env_c)->SetObjectArrayElement(env_c, jargs, count, jstrs);
-        (*env_c)->DeleteLocalRef(env_c, jstrs);
-        count += 1;
+    va_list args, ring_args;
+    va_start(args, format);
+    va_copy(ring_args, args);
+
+    if (ring_command(format, ring_args)) {
+        // the ring is already as cheap as recording the command
+    } else if (frame_depth > 0) {
+        record_command(format, args);
+    } else {
+        forget_last_frame();
+        send_command_list(format, args);
+        frame_shown(true); // drawing outside a frame counts as a frame
     }
 
-    free(str);
+    va_end(ring_args);
     va_end(args);
+}
 
-    return jargs;
+/**
+ * start recording display commands so that a whole frame is sent to the
+ * JavaFX application in one go by displayEndFrame()
+ * frames may be nested, only the outermost displayEndFrame() sends the frame
+ */
+void displayBeginFrame() {
+    // a pending frame's commands are still in the buffer, its starting colour is kept
+    if (frame_depth == 0 && !frame_pending) {
+        pthread_mutex_lock(&display_mutex);
+        strcpy(frame_colour, current_colour);
+        pthread_mutex_unlock(&display_mutex);
+    }
+    frame_depth++;
+}
+
+/**
+ * send the display commands recorded since the matching displayBeginFrame()
+ * the frame is held back if it is too soon after the previous one (see displayFrameRate())
+ */
+void displayEndFrame() {
+    if (frame_depth == 0) return;
+
+    frame_depth--;
+    if (frame_depth > 0) return;
+
+    // an empty frame while the display is off, unless it is the one that cleared it
+    if (display_power == DisplayOff && !display_blanking) return;
+    display_blanking = false;
+
+    if (command_ring != NULL && !display_uploads) {
+        // ring commands have already been written, the emulator paces its own drawing
+        frame_shown(send_frame(true));
+
+        pthread_mutex_lock(&ring_mutex);
+        ringPush(command_ring, RING_END_FRAME, NULL, 0, NULL, 0);
+        pthread_mutex_unlock(&ring_mutex);
+        return;
+    }
+
+    frame_pending = true;
+    present_due_frame();
 }
 
 /**
@@ -547,7 +2131,26 @@ jobjectArray build_args(char *format, ...) {
  * to clear the display
  */
 void displayClear() {
-    call_j_command(build_args("s", "CLEAR_DISPLAY"));
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbClear(&display_buffer);
+
+    // clearing an already clear display in the same colours changes nothing
+    bool elide = display_cleared && strcmp(cleared_colour, current_colour) == 0 && strlen(current_colour) > 0;
+    shadow_drawn(0, 0, FB_WIDTH, FB_HEIGHT);
+    display_cleared = true;
+    strcpy(cleared_colour, current_colour);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (elide && !display_uploads) {
+        statsCount("CLEAR_DISPLAY_ELIDED");
+        return;
+    }
+    if (frame_pending && frame_depth > 0 && !display_uploads && command_ring == NULL) {
+        discard_pending_frame();
+    }
+    display_command("s", "CLEAR_DISPLAY");
 }
 
 /**
@@ -555,7 +2158,7 @@ void displayClear() {
  * to step the motor
  */
 void motorStep() {
-    call_j_command(build_args("s", "MOTOR_STEP")); // 1st argument is format specifier
+    emulator_command("s", "MOTOR_STEP"); // 1st argument is format specifier
 }
 
 /**
@@ -567,7 +2170,14 @@ void motorStep() {
  * @param h
  */
 void displayClearArea(int x, int y, int w, int h) {
-    call_j_command(build_args("sdddd", "CLEAR_AREA", x, y, w, h)); // 1st argument is format specifier
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbClearArea(&display_buffer, x, y, w, h);
+    shadow_drawn(x, y, w, h);
+    pthread_mutex_unlock(&display_mutex);
+
+    display_command("sdddd", "CLEAR_AREA", x, y, w, h); // 1st argument is format specifier
 }
 
 /**
@@ -579,7 +2189,14 @@ void displayClearArea(int x, int y, int w, int h) {
  * @param h
  */
 void displayLine(int x, int y, int w, int h) {
-    call_j_command(build_args("sdddd", "LINE", x, y, w, h)); // 1st argument is format specifier
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbLine(&display_buffer, x, y, w, h);
+    shadow_drawn(x < w ? x : w, y < h ? y : h, abs(w - x) + 1, abs(h - y) + 1); // the line is x,y to w,h
+    pthread_mutex_unlock(&display_mutex);
+
+    display_command("sdddd", "LINE", x, y, w, h); // 1st argument is format specifier
 }
 
 /**
@@ -593,7 +2210,7 @@ void displayLine(int x, int y, int w, int h) {
  * @param year
  */
 void clockSet(int sec, int min, int hour, int day, int month, int year) {
-    call_j_command(build_args("sdddddd", "SET_RTC", sec, min, hour, day, month, year)); // 1st argument is format specifier
+    j_command("sdddddd", "SET_RTC", sec, min, hour, day, month, year); // 1st argument is format specifier
 }
 
 /**
@@ -603,7 +2220,212 @@ void clockSet(int sec, int min, int hour, int day, int month, int year) {
  * @param y
  */
 void displayPixel(int x, int y) {
-    call_j_command(build_args("sdd", "PIXEL", x, y)); // 1st argument is format specifier
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbPixel(&display_buffer, x, y);
+    shadow_drawn(x, y, 1, 1);
+    pthread_mutex_unlock(&display_mutex);
+
+    display_command("sdd", "PIXEL", x, y); // 1st argument is format specifier
+}
+
+/**
+ * the emulator shipped with the project only knows the original display commands. FILL_RECT, INVERT_AREA and
+ * BITMAP can only be used when the framebuffer is uploaded (it is drawn in C) or the command ring is shared
+ * @return true if the emulator can draw them
+ */
+bool display_primitives() {
+    return display_uploads || command_ring != NULL;
+}
+
+/**
+ * @param bits - 1 bit per pixel image, the leftmost pixel in the top bit
+ * @param stride - bytes per row
+ * @param x
+ * @param y
+ * @return true if the pixel is set
+ */
+bool bitmap_pixel(const unsigned char *bits, int stride, int x, int y) {
+    return (bits[y * stride + x / 8] & (0x80 >> (x % 8))) != 0;
+}
+
+/**
+ * draw the set bits of a 1 bit per pixel image in the foreground colour with a LINE command for each run of
+ * set bits in a row, for an emulator that doesn't know BITMAP
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ * @param bits - FB_BITMAP_STRIDE(w) bytes per row
+ */
+void send_bitmap_lines(int x, int y, int w, int h, const unsigned char *bits) {
+    int stride = FB_BITMAP_STRIDE(w);
+
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            if (!bitmap_pixel(bits, stride, col, row)) continue;
+
+            int start = col;
+            while (col + 1 < w && bitmap_pixel(bits, stride, col + 1, row)) col++;
+            display_command("sdddd", "LINE", x + start, y + row, x + col, y + row); // 1st argument is format specifier
+        }
+    }
+}
+
+/**
+ * send the colour command in effect again after drawing in other colours (nothing for the emulator default)
+ */
+void send_current_colour() {
+    char colour[LINE_SIZE];
+
+    pthread_mutex_lock(&display_mutex);
+    strcpy(colour, current_colour);
+    pthread_mutex_unlock(&display_mutex);
+
+    char *bg = strchr(colour, '\t');
+    if (bg == NULL) return;
+    *bg++ = '\0';
+    display_command("sss", "COLOUR", colour, bg); // 1st argument is format specifier
+}
+
+/**
+ * redraw part of the display from the framebuffer, white on black, with commands every emulator knows.
+ * this is how an inverted area is sent to an emulator that doesn't know INVERT_AREA. the commands set every
+ * pixel of the area, so sending them again (e.g. in a repeated frame) draws the same thing
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void send_area(int x, int y, int w, int h) {
+    unsigned char bits[FB_HEIGHT * FB_BITMAP_STRIDE(FB_WIDTH)];
+
+    // only the part on the display
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > FB_WIDTH) w = FB_WIDTH - x;
+    if (y + h > FB_HEIGHT) h = FB_HEIGHT - y;
+    if (w <= 0 || h <= 0) return;
+
+    int stride = FB_BITMAP_STRIDE(w);
+    memset(bits, 0, (size_t)(h * stride));
+    pthread_mutex_lock(&display_mutex);
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            if (fbGetPixel(&display_buffer, x + col, y + row)) bits[row * stride + col / 8] |= 0x80 >> (col % 8);
+        }
+    }
+    pthread_mutex_unlock(&display_mutex);
+
+    display_command("sss", "COLOUR", "white", "black"); // 1st argument is format specifier
+    display_command("sdddd", "CLEAR_AREA", x, y, w, h);
+    send_bitmap_lines(x, y, w, h, bits);
+    send_current_colour();
+}
+
+/**
+ * send message to the JavaFX application
+ * to fill a rectangle with the foreground colour
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void displayFillRect(int x, int y, int w, int h) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbFillRect(&display_buffer, x, y, w, h);
+    shadow_drawn(x, y, w, h);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (display_primitives()) {
+        display_command("sdddd", "FILL_RECT", x, y, w, h); // 1st argument is format specifier
+        return;
+    }
+
+    // a line for each row or column of the part on the display, whichever is fewer
+    int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    int x1 = x + w > FB_WIDTH ? FB_WIDTH - 1 : x + w - 1;
+    int y1 = y + h > FB_HEIGHT ? FB_HEIGHT - 1 : y + h - 1;
+    if (y1 - y0 <= x1 - x0) {
+        for (int row = y0; row <= y1; row++) display_command("sdddd", "LINE", x0, row, x1, row);
+    } else {
+        for (int col = x0; col <= x1; col++) display_command("sdddd", "LINE", col, y0, col, y1);
+    }
+}
+
+/**
+ * send message to the JavaFX application
+ * to invert the pixels of a rectangle
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void displayInvertArea(int x, int y, int w, int h) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbInvertArea(&display_buffer, x, y, w, h);
+    shadow_drawn(x, y, w, h);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (display_primitives()) {
+        display_command("sdddd", "INVERT_AREA", x, y, w, h); // 1st argument is format specifier
+    } else {
+        send_area(x, y, w, h); // the emulator can't invert, send what the area now looks like
+    }
+}
+
+/**
+ * send message to the JavaFX application
+ * to draw a 1 bit per pixel image. the rows are sent as hex digits, a band of rows per command
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ * @param bits - (w + 7) / 8 bytes per row, the leftmost pixel in the top bit of the first byte
+ */
+void displayBitmap(int x, int y, int w, int h, const unsigned char *bits) {
+    static const char hex_digits[] = "0123456789ABCDEF";
+    int stride = FB_BITMAP_STRIDE(w);
+
+    if (w <= 0 || h <= 0 || bits == NULL) return;
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    if (stride > BITMAP_BAND_BYTES) {
+        logAdd(JNI_MESSAGES, "displayBitmap() bitmap is wider than the display, not drawn");
+        return;
+    }
+
+    pthread_mutex_lock(&display_mutex);
+    fbBitmap(&display_buffer, x, y, w, h, bits);
+    bool clear_first = display_buffer.bg != FbTransparent;
+    shadow_drawn(x, y, w, h);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (!display_primitives()) {
+        // clear bits are the background colour, then the set bits are drawn as lines
+        if (clear_first) display_command("sdddd", "CLEAR_AREA", x, y, w, h); // 1st argument is format specifier
+        send_bitmap_lines(x, y, w, h, bits);
+        return;
+    }
+
+    int band_rows = BITMAP_BAND_BYTES / stride;
+    for (int row = 0; row < h; row += band_rows) {
+        char hex[BITMAP_BAND_BYTES * 2 + 1];
+        int rows = (h - row < band_rows) ? h - row : band_rows;
+        const unsigned char *band = bits + row * stride;
+
+        for (int i = 0; i < rows * stride; i++) {
+            hex[i * 2] = hex_digits[band[i] >> 4];
+            hex[i * 2 + 1] = hex_digits[band[i] & 0xF];
+        }
+        hex[rows * stride * 2] = '\0';
+
+        display_command("sdddds", "BITMAP", x, y + row, w, rows, hex); // 1st argument is format specifier
+    }
 }
 
 /**
@@ -612,7 +2434,7 @@ void displayPixel(int x, int y) {
  * @param foodLevel
  */
 void foodFill(int foodLevel) {
-    call_j_command(build_args("sd", "FOOD", foodLevel)); // 1st argument is format specifier
+    emulator_command("sd", "FOOD", foodLevel); // 1st argument is format specifier
 }
 
 /**
@@ -623,7 +2445,39 @@ void foodFill(int foodLevel) {
  * @param size - 1 or 2 are the only two sizes currently supported on the real display
  */
 void displayText(int x, int y, char *text, int size) {
-    call_j_command(build_args("sddsd", "TEXTXY", x, y, text, size)); // 1st argument is format specifier
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+
+    pthread_mutex_lock(&display_mutex);
+    fbText(&display_buffer, x, y, text, size);
+    bool elide = shadow_text(x, y, text, size);
+    pthread_mutex_unlock(&display_mutex);
+
+    if (elide && !display_uploads) {
+        statsCount("TEXTXY_ELIDED");
+        return;
+    }
+    display_command("sddsd", "TEXTXY", x, y, text, size); // 1st argument is format specifier
+}
+
+/**
+ * display text in inverse video, e.g. a highlighted menu item. the text is drawn and then inverted when the
+ * emulator can invert an area (see display_primitives()). otherwise it is drawn white on blue, which the
+ * framebuffer also draws inverted, and the colours are left white on black
+ * @param x - x pixel position
+ * @param y - y pixel position
+ * @param text - the text to display
+ * @param size - 1 or 2
+ */
+void displayTextInverse(int x, int y, char *text, int size) {
+    if (display_primitives()) {
+        displayText(x, y, text, size);
+        displayInvertArea(x, y, (int)strlen(text) * FB_CHAR_WIDTH * size, FB_CHAR_HEIGHT * size);
+        return;
+    }
+
+    displayColour("white", "blue");
+    displayText(x, y, text, size);
+    displayColour("white", "black");
 }
 
 /**
@@ -631,7 +2485,7 @@ void displayText(int x, int y, char *text, int size) {
  * @param text
  */
 void infoMessage(char *text) {
-    call_j_command(build_args("ss", "MESSAGE", text)); // 1st argument is format specifier
+    emulator_command("ss", "MESSAGE", text); // 1st argument is format specifier
 }
 
 /**
@@ -645,7 +2499,27 @@ void infoMessage(char *text) {
  * @param bg background colour
  */
 void displayColour(char *fg, char *bg) {
-    call_j_command(build_args("sss", "COLOUR", fg, bg)); // 1st argument is format specifier
+    pthread_mutex_lock(&display_mutex);
+    fbColour(&display_buffer, fg, bg);
+
+    // the emulator is already using these colours (colour names aren't case sensitive)
+    char colour[LINE_SIZE];
+    fmtText(colour, LINE_SIZE, "%s\t%s", fg, bg);
+    bool elide = strcasecmp(colour, current_colour) == 0;
+    if (!elide) {
+        strcpy(current_colour, colour);
+    }
+    pthread_mutex_unlock(&display_mutex);
+
+    // the colour only affects later drawing so there is nothing to upload
+    if (display_uploads) return;
+
+    if (elide) {
+        statsCount("COLOUR_ELIDED");
+        return;
+    }
+
+    display_command("sss", "COLOUR", fg, bg); // 1st argument is format specifier
 }
 
 /**
@@ -656,7 +2530,111 @@ char *buttonState() {
     //Called to reset the last time the button was pressed so we can turn the screen off after a certain amount of time
     //*timeToTurnOfPtr = clockSecond();
 
-    return call_j_message(build_args("s", "BUTTON")); // 1st argument is format specifier();
+    char state[LINE_SIZE];
+    j_message(state, LINE_SIZE, "s", "BUTTON"); // 1st argument is format specifier
+
+    // heap allocated result that the caller disposes of
+    char *result = malloc(strlen(state) + 1);
+    strcpy(result, state);
+    return result;
+}
+
+/**
+ * poll the emulator for the button state
+ * used when the emulator can't push button events
+ * @return
+ */
+enum ButtonEvent poll_button() {
+    char state[LINE_SIZE];
+    j_message(state, LINE_SIZE, "s", "BUTTON"); // 1st argument is format specifier
+
+    if (strcmp(state, "SHORT_PRESS") == 0) return ShortPress;
+    if (strcmp(state, "LONG_PRESS") == 0) return LongPress;
+    return NoPress;
+}
+
+/**
+ * take the oldest press from the button event queue. the caller must hold button_mutex
+ * @return
+ */
+enum ButtonEvent take_button_event() {
+    char sb[LINE_SIZE];
+
+    if (button_queue_count == 0) return NoPress;
+
+    struct ButtonQueueItem *item = &button_queue[button_queue_head];
+    button_queue_head = (button_queue_head + 1) % BUTTON_QUEUE_SIZE;
+    button_queue_count--;
+
+    if ((log_level & JNI_MESSAGES) > 0) {
+        snprintf(sb, LINE_SIZE, "button event %d handled after %lld ms", item->event, monotonic_ms() - item->time);
+        logAdd(JNI_MESSAGES, sb);
+    }
+    return item->event;
+}
+
+/**
+ * @return the oldest button press not yet handled or NoPress. does not wait
+ */
+enum ButtonEvent buttonPollEvent() {
+    present_due_frame();
+    if (!button_events_pushed) {
+        return poll_button();
+    }
+
+    pthread_mutex_lock(&button_mutex);
+    enum ButtonEvent event = take_button_event();
+    pthread_mutex_unlock(&button_mutex);
+
+    return event;
+}
+
+/**
+ * wait for a button press
+ * if the emulator can't push button events it is polled at the end of each poll interval, which is the timeout
+ * limited to BUTTON_POLL_MS .. BUTTON_POLL_MAX_MS. e.g. a 1 second wait while the screen is off is one poll
+ * @param timeout - maximum time to wait in milliseconds
+ * @return the oldest button press not yet handled or NoPress if there was none before the timeout
+ */
+enum ButtonEvent buttonWaitEvent(long timeout) {
+    long long end = monotonic_ms() + timeout;
+
+    present_due_frame();
+    if (!button_events_pushed) {
+        long interval = timeout < BUTTON_POLL_MS ? BUTTON_POLL_MS : timeout > BUTTON_POLL_MAX_MS ? BUTTON_POLL_MAX_MS : timeout;
+        enum ButtonEvent event;
+        do {
+            long long left = end - monotonic_ms();
+            msleep(left < 0 ? 0 : left < interval ? (long)left : interval);
+            event = poll_button();
+        } while (event == NoPress && monotonic_ms() < end);
+        return event;
+    }
+
+    // condition variable timeouts use the real time clock
+    struct timespec deadline;
+    deadline_after(&deadline, timeout);
+
+    pthread_mutex_lock(&button_mutex);
+    while (button_queue_count == 0 && monotonic_ms() < end) {
+        // wake up to present a frame held back by the frame rate limit
+        long long due = frame_due_ms();
+        if (due >= 0 && due < end - monotonic_ms()) {
+            struct timespec frame_deadline;
+            deadline_after(&frame_deadline, due);
+            if (pthread_cond_timedwait(&button_cond, &button_mutex, &frame_deadline) != 0) {
+                pthread_mutex_unlock(&button_mutex);
+                present_pending_frame();
+                pthread_mutex_lock(&button_mutex);
+            }
+            continue;
+        }
+        if (pthread_cond_timedwait(&button_cond, &button_mutex, &deadline) != 0) break;
+    }
+    enum ButtonEvent event = take_button_event();
+    pthread_mutex_unlock(&button_mutex);
+
+    return event;
 }
 
 /**
@@ -693,50 +2671,73 @@ char *convertLongToString(long value) {
  * @return
  */
 long long int clockWarmStart(long long int offset) {
-    char *resultstr =  call_j_message(build_args("sl", "RTC_WARM_START", offset)); // 1st argument is format specifier();
-    long result = convertStringToLong(resultstr);
-    free(resultstr);
-    return result;
+    if (jmethod_rtc_warm_start != NULL) {
+        attachCurrentThread();
+        long long start = statsNow();
+        jlong result = (*env_c)->CallStaticLongMethod(env_c, jclass_FishFeederEmulator, jmethod_rtc_warm_start,
+                                                      (jlong)offset);
+        jni_call_done("RTC_WARM_START", start);
+        exception_check(env_c, jmethod_name_rtc_warm_start);
+        return (long long int)result;
+    }
+
+    char resultstr[LINE_SIZE];
+    j_message(resultstr, LINE_SIZE, "sl", "RTC_WARM_START", (long)offset); // 1st argument is format specifier
+    return convertStringToLong(resultstr);
 }
 
+// clock items. the number is the item argument of the typed FishFeederEmulator.rtc() method
+enum RtcItem {RtcSecond = 0, RtcMinute = 1, RtcHour = 2, RtcDay = 3, RtcMonth = 4, RtcYear = 5, RtcDayOfWeek = 6};
+char const *const rtc_item_names[] = {"RTC_SECOND", "RTC_MINUTE", "RTC_HOUR", "RTC_DAY", "RTC_MONTH", "RTC_YEAR",
+                                      "RTC_DAY_OF_WEEK"};
+
 /**
- * send a time item message to the JavaFX application and get a response
+ * get a time item from the JavaFX application. uses the typed rtc() method if the emulator has it,
+ * otherwise sends the item name as a message and converts the response
  * @param item
  * @return
  */
-int clockitem(char *item) {
-    char *resultstr =  call_j_message(build_args("s", item)); // 1st argument is format specifier();
-    int result = (int)convertStringToLong(resultstr);
-    free(resultstr);
-    return result;
+int clockitem(enum RtcItem item) {
+    if (jmethod_rtc != NULL) {
+        attachCurrentThread();
+        long long start = statsNow();
+        jint result = (*env_c)->CallStaticIntMethod(env_c, jclass_FishFeederEmulator, jmethod_rtc, (jint)item);
+        jni_call_done(rtc_item_names[item], start);
+        exception_check(env_c, jmethod_name_rtc);
+        return (int)result;
+    }
+
+    char resultstr[LINE_SIZE];
+    j_message(resultstr, LINE_SIZE, "s", rtc_item_names[item]); // 1st argument is format specifier
+    return (int)convertStringToLong(resultstr);
 }
 
 int clockSecond() {
-    return clockitem("RTC_SECOND");
+    return clockitem(RtcSecond);
 }
 
 int clockMinute() {
-    return clockitem("RTC_MINUTE");
+    return clockitem(RtcMinute);
 }
 
 int clockHour() {
-    return clockitem("RTC_HOUR");
+    return clockitem(RtcHour);
 }
 
 int clockDay() {
-    return clockitem("RTC_DAY");
+    return clockitem(RtcDay);
 }
 
 int clockMonth() {
-    return clockitem("RTC_MONTH");
+    return clockitem(RtcMonth);
 }
 
 int clockYear() {
-    return clockitem("RTC_YEAR");
+    return clockitem(RtcYear);
 }
 
 int clockDayOfWeek() {
-    return clockitem("RTC_DAY_OF_WEEK");
+    return clockitem(RtcDayOfWeek);
 }
 
 /**
@@ -903,7 +2904,7 @@ int howManyLinesInFile(char* filename) {
 
 void displayNumberOfFeeds(int x, int y, int numFeeds, int numFeedsSize) {
     char numFeedsString[100];
-    sprintf(numFeedsString, "No. feeds:%d", numFeeds);
+    fmtText(numFeedsString, sizeof(numFeedsString), "No. feeds:%d", numFeeds);
 
     //Display no. feeds since booted up
     displayText(x, y, numFeedsString, numFeedsSize);
@@ -969,13 +2970,11 @@ void displayDefaultDateValues(int x, int y, int numVals, FeedTime *valsToWrite)
         }
 
         displayText(GUI_OFFSET_DEFAULT_DATE_X(x, i), GUI_OFFSET_PURPOSE_DATE_Y(y, 1), valuePurposes[i], 1);
-        char *toString[20];
-        if (writingVal > 10) {
-            sprintf(toString, "%d", writingVal);
-        }else if (writingVal != 0 && i != 2){
-            sprintf(toString, "0%d", writingVal);
+        char toString[FMT_INT_SIZE];
+        if (writingVal != 0 && i != 2){
+            fmtIntWidth(toString, sizeof(toString), writingVal, 2, '0');
         }else {
-            sprintf(toString, "%d", writingVal);
+            fmtInt(toString, sizeof(toString), writingVal);
         }
         displayText(GUI_OFFSET_DEFAULT_DATE_X(x, i), GUI_OFFSET_DEFAULT_DATE_Y(y, 1), toString, 1);
     }
@@ -1015,13 +3014,11 @@ void displayDefaultClockValues(int x, int y, int numVals, ClockTime *valsToWrite
             displayText(GUI_OFFSET_DEFAULT_DATE_X(x, (i - ((levelChecker - 1) * 3))), GUI_OFFSET_PURPOSE_DATE_Y(y, 1.5 * levelChecker), valuePurposes[i], 1);
         }
 
-        char *toString[20];
-        if (writingVal > 10) {
-            sprintf(toString, "%d", writingVal);
-        }else if (writingVal != 0){
-            sprintf(toString, "0%d", writingVal);
+        char toString[FMT_INT_SIZE];
+        if (writingVal != 0){
+            fmtIntWidth(toString, sizeof(toString), writingVal, 2, '0');
         }else {
-            sprintf(toString, "%d", writingVal);
+            fmtInt(toString, sizeof(toString), writingVal);
         }
         displayText(GUI_OFFSET_DEFAULT_DATE_X(x, (i - ((levelChecker - 1) * 3))), GUI_OFFSET_DEFAULT_DATE_Y(y, levelChecker), toString, 1);
     }
@@ -1038,7 +3035,7 @@ void displayDefaultClockValues(int x, int y, int numVals, ClockTime *valsToWrite
  */
 void displayNumberPicker(int x, int y, int *currentTSI, int *currentTSV) {
     //Highlight the current value the user is selecting
-    char* valuePickedAsString[20];
+    char valuePickedAsString[FMT_INT_SIZE];
 
     //levelChecker is responsible for making sure all the information for the number picker can be displayed within the screen
     //We do this by making the GUI print the remaining values a level below the first ones
@@ -1048,7 +3045,7 @@ void displayNumberPicker(int x, int y, int *currentTSI, int *currentTSV) {
         levelChecker = 2;
     }
 
-    sprintf(valuePickedAsString, "%d", *currentTSV);
+    fmtInt(valuePickedAsString, sizeof(valuePickedAsString), *currentTSV);
     displayTextHighlighted(GUI_OFFSET_DEFAULT_DATE_X(x, (*currentTSI - ((levelChecker - 1) * 3))), GUI_OFFSET_DEFAULT_DATE_Y(y, levelChecker), valuePickedAsString, 1);
 }
 
@@ -1079,9 +3076,8 @@ void displayTitle(char* title) {
 }
 
 void displayTextHighlighted(int x, int y, char* text, int textSize) {
-    displayColour("white", "blue");
-    displayText(x, y, text, textSize);
     displayColour("white", "black");
+    displayTextInverse(x, y, text, textSize);
 }
 
 void parseTimeToFile(FeedTime *timesToSave, char * filename) {
@@ -1185,11 +3181,8 @@ void motorDisplay(int x, int y, int motorTurn) {
 }
 
 void nextFeedTimeToString(char *timeString, FeedTime *timeptr) {
-    if (timeptr->minute < 10) {
-        sprintf(timeString, "%d:0%d", timeptr->hour, timeptr->minute);
-    }else {
-        sprintf(timeString, "%d:%d", timeptr->hour, timeptr->minute);
-    }
+    //The callers' buffers are 20 characters
+    fmtHourMinute(timeString, 20, timeptr->hour, timeptr->minute);
 }
 
 /**
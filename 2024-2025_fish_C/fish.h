@@ -23,6 +23,21 @@ void displayText(int x, int y, char* text, int size); // pixel coordinates; size
 void displayPixel(int x, int y); // set an individual pixel;
 void displayLine(int x, int y, int w, int h); // draw a line between any two coordinates on the display
 void displayClearArea(int x, int y, int w, int h); // clear part of the display to the background colour
+void displayFillRect(int x, int y, int w, int h); // fill a rectangle with the foreground colour
+void displayInvertArea(int x, int y, int w, int h); // invert every pixel in a rectangle, e.g. to highlight
+void displayTextInverse(int x, int y, char* text, int size); // text in inverse video, e.g. a highlighted item
+// draw a 1 bit per pixel image. each row is (w + 7) / 8 bytes with the leftmost pixel in the top bit.
+// set bits are drawn in the foreground colour and clear bits in the background colour
+void displayBitmap(int x, int y, int w, int h, const unsigned char *bits);
+// display frames. display commands between these calls are collected and sent to the display together
+void displayBeginFrame(); // start collecting display commands for a frame. frames may be nested
+void displayEndFrame(); // send the collected display commands (at the end of the outermost frame)
+void displayFrameRate(int fps); // present at most fps frames a second, later frames replace held back ones. 0 = no limit
+// display power. turning the display off clears it and then nothing is drawn (or sent) until it is turned on
+// again, when it is blank and must be redrawn. dimmed lowers the contrast of the real panel
+enum DisplayPower {DisplayOn = 0, DisplayDimmed = 1, DisplayOff = 2};
+void displayPower(enum DisplayPower power);
+enum DisplayPower displayPowerState();
 
 // real time clock (RTC) functions
 // set the clock.
@@ -48,6 +63,10 @@ void foodFill(int foodLevel); // set food level. range 1 - 60%
 // button function
 // returns one of "SHORT_PRESS" "LONG_PRESS" "NO_PRESS"
 char* buttonState(); // note caller must dispose of char* result
+// button events. presses are queued as they happen so none are lost between checks
+enum ButtonEvent {NoPress = 0, ShortPress = 1, LongPress = 2};
+enum ButtonEvent buttonPollEvent(); // the oldest queued press or NoPress if there isn't one. does not wait
+enum ButtonEvent buttonWaitEvent(long timeout); // wait up to timeout milliseconds for a press. NoPress if none
 
 //------------------
 // utility functions
@@ -64,6 +83,26 @@ void userProcessing();
 // new thread for user processing allowing the GUI to run in the main thread.
 int jniSetup(); // setup the JavaFX GUI and then run userProcessing() once GUI is initialised
 int javaFx(); // start the JavaFX GUI - must be called after jniSetup returns when GUI quits
+// optional preparation (loading files etc.) that runs in its own thread while the JVM and GUI start.
+// call before jniSetup(). the function must not use the emulator functions. userProcessing() waits for it
+void jniPrepare(void (*prepare)());
+
+// asynchronous mode. commands that don't return a result (display, motor, food, info) are queued and
+// sent by a separate thread so the caller never waits for the GUI. off by default
+void jniAsync(bool enable); // call from the userProcessing() thread. turning it off waits for queued commands
+void jniFence(); // wait until every command queued so far has been sent
+
+// JNI call statistics. the number of calls and a latency histogram are kept for each command/message opcode.
+// they can also be written by sending the process SIGUSR1 (text to the console and JSON to jni_stats.json)
+void jniStats(char *filename, bool json); // write calls, mean, p50, p99 and max per opcode. NULL for the console
+void jniStatsReset(); // start the statistics again
+// running totals since startup. the debug version makes no jni calls
+typedef struct jniCounts {
+    unsigned long frames; // display frames that sent something or changed the display (not empty or repeated ones)
+    unsigned long display_commands; // display commands sent or added to a frame (not those that weren't needed)
+    unsigned long jni_calls; // round trips into java
+} JniCounts;
+void jniCounts(JniCounts *counts);
 
 // delay for a specified number of milliseconds
 int msleep(long msec);
@@ -4,13 +4,18 @@
  *
  * This is a mock up of the functions intended to call the JavaFX GUI
  * This version uses the console to log calls and produces the display
- * as an SVG file that can be viewed in the browser. This it is single threaded and
+ * as an SVG file that can be viewed in the browser. The user code runs in a single thread and
  * does not produce SIGSEV signals (as java does as part of it memory management causing
  * false 'crash' signals in most debuggers used by CLion)
  *
  * After each call to a display function the file will be updated to reflect
- * the current contents of the display. The user must refresh the broswer page to
+ * the current contents of the display (or once at the end of a frame when the
+ * calls are made between displayBeginFrame() and displayEndFrame()). The user must refresh the broswer page to
  * view the updatesd display.
+ * The file is written by a background thread. It writes the latest frame at most SVG_WRITE_FPS times a second
+ * (see displayFrameRate() and SVG_FPS_ENV), frames drawn in between replace the one waiting to be written, and a
+ * frame the same as the last one written is skipped. The file is written under another name and then renamed,
+ * so the browser never sees half a file.
  *
  * All output from the calls to GUI functions will be prefixed with "GUI:"
  */
@@ -22,9 +27,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "fish.h"
+#include "fish_fb.h"
+#include "fish_ssd1306.h"
+#include "fish_stats.h"
 
 // string buffer size
 #define LINE_SIZE 200
@@ -41,265 +52,6 @@ const int GENERAL = 1 << 5;
 const int STACK_INFO = 1 << 6; // stack trace information
 const int GUI_INFO_DEBUG = 1<<7;
 
-// the character font for the display
-const unsigned char BASIC_FONT[] = {
-        0x00, 0x00, 0x00, 0x00, 0x00,
-        0x3E, 0x5B, 0x4F, 0x5B, 0x3E,
-        0x3E, 0x6B, 0x4F, 0x6B, 0x3E,
-        0x1C, 0x3E, 0x7C, 0x3E, 0x1C,
-        0x18, 0x3C, 0x7E, 0x3C, 0x18,
-        0x1C, 0x57, 0x7D, 0x57, 0x1C,
-        0x1C, 0x5E, 0x7F, 0x5E, 0x1C,
-        0x00, 0x18, 0x3C, 0x18, 0x00,
-        0xFF, 0xE7, 0xC3, 0xE7, 0xFF,
-        0x00, 0x18, 0x24, 0x18, 0x00,
-        0xFF, 0xE7, 0xDB, 0xE7, 0xFF,
-        0x30, 0x48, 0x3A, 0x06, 0x0E,
-        0x26, 0x29, 0x79, 0x29, 0x26,
-        0x40, 0x7F, 0x05, 0x05, 0x07,
-        0x40, 0x7F, 0x05, 0x25, 0x3F,
-        0x5A, 0x3C, 0xE7, 0x3C, 0x5A,
-        0x7F, 0x3E, 0x1C, 0x1C, 0x08,
-        0x08, 0x1C, 0x1C, 0x3E, 0x7F,
-        0x14, 0x22, 0x7F, 0x22, 0x14,
-        0x5F, 0x5F, 0x00, 0x5F, 0x5F,
-        0x06, 0x09, 0x7F, 0x01, 0x7F,
-        0x00, 0x66, 0x89, 0x95, 0x6A,
-        0x60, 0x60, 0x60, 0x60, 0x60,
-        0x94, 0xA2, 0xFF, 0xA2, 0x94,
-        0x08, 0x04, 0x7E, 0x04, 0x08,
-        0x10, 0x20, 0x7E, 0x20, 0x10,
-        0x08, 0x08, 0x2A, 0x1C, 0x08,
-        0x08, 0x1C, 0x2A, 0x08, 0x08,
-        0x1E, 0x10, 0x10, 0x10, 0x10,
-        0x0C, 0x1E, 0x0C, 0x1E, 0x0C,
-        0x30, 0x38, 0x3E, 0x38, 0x30,
-        0x06, 0x0E, 0x3E, 0x0E, 0x06,
-        0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x5F, 0x00, 0x00,
-        0x00, 0x07, 0x00, 0x07, 0x00,
-        0x14, 0x7F, 0x14, 0x7F, 0x14,
-        0x24, 0x2A, 0x7F, 0x2A, 0x12,
-        0x23, 0x13, 0x08, 0x64, 0x62,
-        0x36, 0x49, 0x56, 0x20, 0x50,
-        0x00, 0x08, 0x07, 0x03, 0x00,
-        0x00, 0x1C, 0x22, 0x41, 0x00,
-        0x00, 0x41, 0x22, 0x1C, 0x00,
-        0x2A, 0x1C, 0x7F, 0x1C, 0x2A,
-        0x08, 0x08, 0x3E, 0x08, 0x08,
-        0x00, 0x80, 0x70, 0x30, 0x00,
-        0x08, 0x08, 0x08, 0x08, 0x08,
-        0x00, 0x00, 0x60, 0x60, 0x00,
-        0x20, 0x10, 0x08, 0x04, 0x02,
-        0x3E, 0x51, 0x49, 0x45, 0x3E,
-        0x00, 0x42, 0x7F, 0x40, 0x00,
-        0x72, 0x49, 0x49, 0x49, 0x46,
-        0x21, 0x41, 0x49, 0x4D, 0x33,
-        0x18, 0x14, 0x12, 0x7F, 0x10,
-        0x27, 0x45, 0x45, 0x45, 0x39,
-        0x3C, 0x4A, 0x49, 0x49, 0x31,
-        0x41, 0x21, 0x11, 0x09, 0x07,
-        0x36, 0x49, 0x49, 0x49, 0x36,
-        0x46, 0x49, 0x49, 0x29, 0x1E,
-        0x00, 0x00, 0x14, 0x00, 0x00,
-        0x00, 0x40, 0x34, 0x00, 0x00,
-        0x00, 0x08, 0x14, 0x22, 0x41,
-        0x14, 0x14, 0x14, 0x14, 0x14,
-        0x00, 0x41, 0x22, 0x14, 0x08,
-        0x02, 0x01, 0x59, 0x09, 0x06,
-        0x3E, 0x41, 0x5D, 0x59, 0x4E,
-        0x7C, 0x12, 0x11, 0x12, 0x7C,
-        0x7F, 0x49, 0x49, 0x49, 0x36,
-        0x3E, 0x41, 0x41, 0x41, 0x22,
-        0x7F, 0x41, 0x41, 0x41, 0x3E,
-        0x7F, 0x49, 0x49, 0x49, 0x41,
-        0x7F, 0x09, 0x09, 0x09, 0x01,
-        0x3E, 0x41, 0x41, 0x51, 0x73,
-        0x7F, 0x08, 0x08, 0x08, 0x7F,
-        0x00, 0x41, 0x7F, 0x41, 0x00,
-        0x20, 0x40, 0x41, 0x3F, 0x01,
-        0x7F, 0x08, 0x14, 0x22, 0x41,
-        0x7F, 0x40, 0x40, 0x40, 0x40,
-        0x7F, 0x02, 0x1C, 0x02, 0x7F,
-        0x7F, 0x04, 0x08, 0x10, 0x7F,
-        0x3E, 0x41, 0x41, 0x41, 0x3E,
-        0x7F, 0x09, 0x09, 0x09, 0x06,
-        0x3E, 0x41, 0x51, 0x21, 0x5E,
-        0x7F, 0x09, 0x19, 0x29, 0x46,
-        0x26, 0x49, 0x49, 0x49, 0x32,
-        0x03, 0x01, 0x7F, 0x01, 0x03,
-        0x3F, 0x40, 0x40, 0x40, 0x3F,
-        0x1F, 0x20, 0x40, 0x20, 0x1F,
-        0x3F, 0x40, 0x38, 0x40, 0x3F,
-        0x63, 0x14, 0x08, 0x14, 0x63,
-        0x03, 0x04, 0x78, 0x04, 0x03,
-        0x61, 0x59, 0x49, 0x4D, 0x43,
-        0x00, 0x7F, 0x41, 0x41, 0x41,
-        0x02, 0x04, 0x08, 0x10, 0x20,
-        0x00, 0x41, 0x41, 0x41, 0x7F,
-        0x04, 0x02, 0x01, 0x02, 0x04,
-        0x40, 0x40, 0x40, 0x40, 0x40,
-        0x00, 0x03, 0x07, 0x08, 0x00,
-        0x20, 0x54, 0x54, 0x78, 0x40,
-        0x7F, 0x28, 0x44, 0x44, 0x38,
-        0x38, 0x44, 0x44, 0x44, 0x28,
-        0x38, 0x44, 0x44, 0x28, 0x7F,
-        0x38, 0x54, 0x54, 0x54, 0x18,
-        0x00, 0x08, 0x7E, 0x09, 0x02,
-        0x18, 0xA4, 0xA4, 0x9C, 0x78,
-        0x7F, 0x08, 0x04, 0x04, 0x78,
-        0x00, 0x44, 0x7D, 0x40, 0x00,
-        0x20, 0x40, 0x40, 0x3D, 0x00,
-        0x7F, 0x10, 0x28, 0x44, 0x00,
-        0x00, 0x41, 0x7F, 0x40, 0x00,
-        0x7C, 0x04, 0x78, 0x04, 0x78,
-        0x7C, 0x08, 0x04, 0x04, 0x78,
-        0x38, 0x44, 0x44, 0x44, 0x38,
-        0xFC, 0x18, 0x24, 0x24, 0x18,
-        0x18, 0x24, 0x24, 0x18, 0xFC,
-        0x7C, 0x08, 0x04, 0x04, 0x08,
-        0x48, 0x54, 0x54, 0x54, 0x24,
-        0x04, 0x04, 0x3F, 0x44, 0x24,
-        0x3C, 0x40, 0x40, 0x20, 0x7C,
-        0x1C, 0x20, 0x40, 0x20, 0x1C,
-        0x3C, 0x40, 0x30, 0x40, 0x3C,
-        0x44, 0x28, 0x10, 0x28, 0x44,
-        0x4C, 0x90, 0x90, 0x90, 0x7C,
-        0x44, 0x64, 0x54, 0x4C, 0x44,
-        0x00, 0x08, 0x36, 0x41, 0x00,
-        0x00, 0x00, 0x77, 0x00, 0x00,
-        0x00, 0x41, 0x36, 0x08, 0x00,
-        0x02, 0x01, 0x02, 0x04, 0x02,
-        0x3C, 0x26, 0x23, 0x26, 0x3C,
-        0x1E, 0xA1, 0xA1, 0x61, 0x12,
-        0x3A, 0x40, 0x40, 0x20, 0x7A,
-        0x38, 0x54, 0x54, 0x55, 0x59,
-        0x21, 0x55, 0x55, 0x79, 0x41,
-        0x21, 0x54, 0x54, 0x78, 0x41,
-        0x21, 0x55, 0x54, 0x78, 0x40,
-        0x20, 0x54, 0x55, 0x79, 0x40,
-        0x0C, 0x1E, 0x52, 0x72, 0x12,
-        0x39, 0x55, 0x55, 0x55, 0x59,
-        0x39, 0x54, 0x54, 0x54, 0x59,
-        0x39, 0x55, 0x54, 0x54, 0x58,
-        0x00, 0x00, 0x45, 0x7C, 0x41,
-        0x00, 0x02, 0x45, 0x7D, 0x42,
-        0x00, 0x01, 0x45, 0x7C, 0x40,
-        0xF0, 0x29, 0x24, 0x29, 0xF0,
-        0xF0, 0x28, 0x25, 0x28, 0xF0,
-        0x7C, 0x54, 0x55, 0x45, 0x00,
-        0x20, 0x54, 0x54, 0x7C, 0x54,
-        0x7C, 0x0A, 0x09, 0x7F, 0x49,
-        0x32, 0x49, 0x49, 0x49, 0x32,
-        0x32, 0x48, 0x48, 0x48, 0x32,
-        0x32, 0x4A, 0x48, 0x48, 0x30,
-        0x3A, 0x41, 0x41, 0x21, 0x7A,
-        0x3A, 0x42, 0x40, 0x20, 0x78,
-        0x00, 0x9D, 0xA0, 0xA0, 0x7D,
-        0x39, 0x44, 0x44, 0x44, 0x39,
-        0x3D, 0x40, 0x40, 0x40, 0x3D,
-        0x3C, 0x24, 0xFF, 0x24, 0x24,
-        0x48, 0x7E, 0x49, 0x43, 0x66,
-        0x2B, 0x2F, 0xFC, 0x2F, 0x2B,
-        0xFF, 0x09, 0x29, 0xF6, 0x20,
-        0xC0, 0x88, 0x7E, 0x09, 0x03,
-        0x20, 0x54, 0x54, 0x79, 0x41,
-        0x00, 0x00, 0x44, 0x7D, 0x41,
-        0x30, 0x48, 0x48, 0x4A, 0x32,
-        0x38, 0x40, 0x40, 0x22, 0x7A,
-        0x00, 0x7A, 0x0A, 0x0A, 0x72,
-        0x7D, 0x0D, 0x19, 0x31, 0x7D,
-        0x26, 0x29, 0x29, 0x2F, 0x28,
-        0x26, 0x29, 0x29, 0x29, 0x26,
-        0x30, 0x48, 0x4D, 0x40, 0x20,
-        0x38, 0x08, 0x08, 0x08, 0x08,
-        0x08, 0x08, 0x08, 0x08, 0x38,
-        0x2F, 0x10, 0xC8, 0xAC, 0xBA,
-        0x2F, 0x10, 0x28, 0x34, 0xFA,
-        0x00, 0x00, 0x7B, 0x00, 0x00,
-        0x08, 0x14, 0x2A, 0x14, 0x22,
-        0x22, 0x14, 0x2A, 0x14, 0x08,
-        0xAA, 0x00, 0x55, 0x00, 0xAA,
-        0xAA, 0x55, 0xAA, 0x55, 0xAA,
-        0x00, 0x00, 0x00, 0xFF, 0x00,
-        0x10, 0x10, 0x10, 0xFF, 0x00,
-        0x14, 0x14, 0x14, 0xFF, 0x00,
-        0x10, 0x10, 0xFF, 0x00, 0xFF,
-        0x10, 0x10, 0xF0, 0x10, 0xF0,
-        0x14, 0x14, 0x14, 0xFC, 0x00,
-        0x14, 0x14, 0xF7, 0x00, 0xFF,
-        0x00, 0x00, 0xFF, 0x00, 0xFF,
-        0x14, 0x14, 0xF4, 0x04, 0xFC,
-        0x14, 0x14, 0x17, 0x10, 0x1F,
-        0x10, 0x10, 0x1F, 0x10, 0x1F,
-        0x14, 0x14, 0x14, 0x1F, 0x00,
-        0x10, 0x10, 0x10, 0xF0, 0x00,
-        0x00, 0x00, 0x00, 0x1F, 0x10,
-        0x10, 0x10, 0x10, 0x1F, 0x10,
-        0x10, 0x10, 0x10, 0xF0, 0x10,
-        0x00, 0x00, 0x00, 0xFF, 0x10,
-        0x10, 0x10, 0x10, 0x10, 0x10,
-        0x10, 0x10, 0x10, 0xFF, 0x10,
-        0x00, 0x00, 0x00, 0xFF, 0x14,
-        0x00, 0x00, 0xFF, 0x00, 0xFF,
-        0x00, 0x00, 0x1F, 0x10, 0x17,
-        0x00, 0x00, 0xFC, 0x04, 0xF4,
-        0x14, 0x14, 0x17, 0x10, 0x17,
-        0x14, 0x14, 0xF4, 0x04, 0xF4,
-        0x00, 0x00, 0xFF, 0x00, 0xF7,
-        0x14, 0x14, 0x14, 0x14, 0x14,
-        0x14, 0x14, 0xF7, 0x00, 0xF7,
-        0x14, 0x14, 0x14, 0x17, 0x14,
-        0x10, 0x10, 0x1F, 0x10, 0x1F,
-        0x14, 0x14, 0x14, 0xF4, 0x14,
-        0x10, 0x10, 0xF0, 0x10, 0xF0,
-        0x00, 0x00, 0x1F, 0x10, 0x1F,
-        0x00, 0x00, 0x00, 0x1F, 0x14,
-        0x00, 0x00, 0x00, 0xFC, 0x14,
-        0x00, 0x00, 0xF0, 0x10, 0xF0,
-        0x10, 0x10, 0xFF, 0x10, 0xFF,
-        0x14, 0x14, 0x14, 0xFF, 0x14,
-        0x10, 0x10, 0x10, 0x1F, 0x00,
-        0x00, 0x00, 0x00, 0xF0, 0x10,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-        0xFF, 0xFF, 0xFF, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0xFF, 0xFF,
-        0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-        0x38, 0x44, 0x44, 0x38, 0x44,
-        0x7C, 0x2A, 0x2A, 0x3E, 0x14,
-        0x7E, 0x02, 0x02, 0x06, 0x06,
-        0x02, 0x7E, 0x02, 0x7E, 0x02,
-        0x63, 0x55, 0x49, 0x41, 0x63,
-        0x38, 0x44, 0x44, 0x3C, 0x04,
-        0x40, 0x7E, 0x20, 0x1E, 0x20,
-        0x06, 0x02, 0x7E, 0x02, 0x02,
-        0x99, 0xA5, 0xE7, 0xA5, 0x99,
-        0x1C, 0x2A, 0x49, 0x2A, 0x1C,
-        0x4C, 0x72, 0x01, 0x72, 0x4C,
-        0x30, 0x4A, 0x4D, 0x4D, 0x30,
-        0x30, 0x48, 0x78, 0x48, 0x30,
-        0xBC, 0x62, 0x5A, 0x46, 0x3D,
-        0x3E, 0x49, 0x49, 0x49, 0x00,
-        0x7E, 0x01, 0x01, 0x01, 0x7E,
-        0x2A, 0x2A, 0x2A, 0x2A, 0x2A,
-        0x44, 0x44, 0x5F, 0x44, 0x44,
-        0x40, 0x51, 0x4A, 0x44, 0x40,
-        0x40, 0x44, 0x4A, 0x51, 0x40,
-        0x00, 0x00, 0xFF, 0x01, 0x03,
-        0xE0, 0x80, 0xFF, 0x00, 0x00,
-        0x08, 0x08, 0x6B, 0x6B, 0x08,
-        0x36, 0x12, 0x36, 0x24, 0x36,
-        0x06, 0x0F, 0x09, 0x0F, 0x06,
-        0x00, 0x00, 0x18, 0x18, 0x00,
-        0x00, 0x00, 0x10, 0x10, 0x00,
-        0x30, 0x40, 0xFF, 0x01, 0x01,
-        0x00, 0x1F, 0x01, 0x01, 0x1E,
-        0x00, 0x19, 0x1D, 0x17, 0x12,
-        0x00, 0x3C, 0x3C, 0x3C, 0x3C,
-        0x00, 0x00, 0x00, 0x00, 0x00,
-};
-
 // since this is only a mock up of the GUI simulation for the purposes of allowing testing
 // without multiple threads and JavaFX/jni calls we make do with some globals for simplicity
 
@@ -308,19 +60,27 @@ int  log_level = 0; // global that stores the current log level setting
 // the real time clock
 time_t RTC_offset; // the offset for the rtc
 
-FILE * output_file ;
-#define DISPLAY_WIDTH 128
-#define DISPLAY_HEIGHT 64
+FILE * output_file ; // used by the svg writer thread
+#define DISPLAY_WIDTH FB_WIDTH
+#define DISPLAY_HEIGHT FB_HEIGHT
 #define DISPLAY_SCALE 5
-#define COLOUR_MAX_CHARS 25
 // with of the border around each pixel
 #define SVG_STROKE_WIDTH "0.5"
-
-// the OLED display
-char oled[DISPLAY_WIDTH][DISPLAY_HEIGHT][COLOUR_MAX_CHARS+1]; //25 max colour name length
-char display_bg[COLOUR_MAX_CHARS+1] = "BLACK";
-char display_fg[COLOUR_MAX_CHARS+1] = "WHITE";
+// svg colours of lit and unlit pixels
+#define SVG_LIT_COLOUR "WHITE"
+#define SVG_UNLIT_COLOUR "BLACK"
+
+// the OLED display. drawn by the same rasterizer as the JavaFX version so the output matches
+FrameBuffer oled = {.fg = FbLit, .bg = FbUnlit};
+FbPresenter oled_presenter; // the svg file is only rewritten when the display has changed
+Ssd1306 oled_ssd; // the display controller, to show the I2C traffic the real display would need
 #define DISPLAY_SVG_FILENAME "display.svg"
+#define DISPLAY_SVG_TEMP_FILENAME "display.svg.tmp" // written first and then renamed to DISPLAY_SVG_FILENAME
+int frame_depth = 0; // nesting level of displayBeginFrame() calls
+enum DisplayPower display_power = DisplayOn; // nothing is drawn while the display is off
+unsigned long display_frames = 0; // svg files written, for jniCounts()
+unsigned long display_commands = 0; // display functions called while the display is on
+void (*prepare_function)() = NULL; // see jniPrepare()
 
 // feeder motor
 #define STEP_ANGLE 1
@@ -330,6 +90,177 @@ double SCOOP_SIZE = 0.01; // amount of food taken at each full scoop
 double MIN_FOOD = 0.01; // prevent problems if no food exists.
 double foodVolume = 0.25;
 
+// emulator colours. the framebuffer only has lit and unlit pixels, which is all the real display needs. once a
+// colour other than black or white is used each pixel also gets a 4 bit index into a palette of the colour names
+// it was drawn in (4 KB for the display). the names are only looked up when the svg file is written
+#define PALETTE_SIZE 16
+#define PALETTE_NAME_SIZE 32
+#define PALETTE_UNLIT 0
+#define PALETTE_LIT 1
+char palette[PALETTE_SIZE][PALETTE_NAME_SIZE] = {SVG_UNLIT_COLOUR, SVG_LIT_COLOUR};
+int palette_count = 2;
+uint8_t oled_colours[DISPLAY_HEIGHT][DISPLAY_WIDTH / 2]; // two palette indices per byte, low nibble the even x
+bool oled_coloured = false; // oled_colours is in use
+bool oled_colours_changed = false; // a pixel has changed colour since the svg file was written
+int fg_index = PALETTE_LIT; // palette entries of the current colours, -1 if transparent
+int bg_index = PALETTE_UNLIT;
+
+// the svg file writer thread. saveDisplay() leaves a snapshot of the display in svg_next and the thread writes
+// the latest one, at most svg_fps files a second. the svg_ variables are protected by svg_mutex
+#define SVG_WRITE_FPS 10 // default limit, writing the file takes a few milliseconds
+#define SVG_FPS_ENV "FISH_SVG_FPS" // overrides the limit set by displayFrameRate(), 0 for no limit
+
+typedef struct svgSnapshot {
+    FrameBuffer fb;
+    bool coloured; // the colours and palette are only used if the emulator colours were used
+    uint8_t colours[DISPLAY_HEIGHT][DISPLAY_WIDTH / 2];
+    char palette[PALETTE_SIZE][PALETTE_NAME_SIZE];
+    int palette_count;
+} SvgSnapshot;
+
+pthread_mutex_t svg_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t svg_cond = PTHREAD_COND_INITIALIZER; // signalled when a snapshot is left or the writer must stop
+pthread_t svg_thread;
+bool svg_started = false; // the writer thread is running
+bool svg_stopping = false; // write anything still waiting and finish
+bool svg_pending = false; // svg_next is waiting to be written
+SvgSnapshot svg_next;
+SvgSnapshot svg_writing; // the snapshot being written, only used by the writer thread
+int svg_fps = SVG_WRITE_FPS;
+bool svg_fps_fixed = false; // set by SVG_FPS_ENV, displayFrameRate() doesn't change it
+unsigned long svg_written = 0; // files written
+unsigned long svg_replaced = 0; // snapshots replaced by a later one before they were written
+unsigned long svg_unchanged = 0; // snapshots the same as the last file written
+
+
+/**
+ * find or add the palette entry for a colour
+ * @param colour - colour name or hex string
+ * @param ink - how the framebuffer draws it
+ * @return palette index, -1 for transparent. lit or unlit if the palette is full
+ */
+int palette_index(const char *colour, enum FbInk ink) {
+    if (ink == FbTransparent) return -1;
+    if (strcasecmp(colour, "black") == 0) return PALETTE_UNLIT;
+    if (strcasecmp(colour, "white") == 0) return PALETTE_LIT;
+
+    for (int i = 0; i < palette_count; i++) {
+        if (strcasecmp(colour, palette[i]) == 0) return i;
+    }
+    if (palette_count == PALETTE_SIZE || strlen(colour) >= PALETTE_NAME_SIZE) {
+        return ink == FbLit ? PALETTE_LIT : PALETTE_UNLIT;
+    }
+    strcpy(palette[palette_count], colour);
+    return palette_count++;
+}
+
+/**
+ * @param colours - oled_colours or a snapshot of it
+ * @param x
+ * @param y
+ * @return palette index of a pixel
+ */
+int colour_index(const uint8_t colours[DISPLAY_HEIGHT][DISPLAY_WIDTH / 2], int x, int y) {
+    uint8_t pair = colours[y][x / 2];
+    return (x & 1) ? pair >> 4 : pair & 0x0F;
+}
+
+/**
+ * @param x
+ * @param y
+ * @param index - palette index
+ */
+void set_colour_index(int x, int y, int index) {
+    uint8_t *pair = &oled_colours[y][x / 2];
+    uint8_t updated = (x & 1) ? (uint8_t)((*pair & 0x0F) | (index << 4)) : (uint8_t)((*pair & 0xF0) | index);
+    if (updated != *pair) {
+        *pair = updated;
+        oled_colours_changed = true;
+    }
+}
+
+/**
+ * start recording the colour of each pixel, from the lit and unlit pixels so far
+ */
+void start_colours() {
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            set_colour_index(x, y, fbGetPixel(&oled, x, y) ? PALETTE_LIT : PALETTE_UNLIT);
+        }
+    }
+    oled_coloured = true;
+}
+
+/**
+ * record the colours of an area that has just been cleared or inverted, which writes every pixel of it. pixels
+ * in the foreground state get the foreground colour and the others the background colour (neither if it is
+ * transparent)
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void colour_area(int x, int y, int w, int h) {
+    if (!oled_coloured) return;
+
+    int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    int x1 = x + w > DISPLAY_WIDTH ? DISPLAY_WIDTH : x + w;
+    int y1 = y + h > DISPLAY_HEIGHT ? DISPLAY_HEIGHT : y + h;
+    bool fg_lit = oled.fg == FbLit;
+
+    for (int py = y0; py < y1; py++) {
+        for (int px = x0; px < x1; px++) {
+            bool is_fg = fbGetPixel(&oled, px, py) == fg_lit;
+            int index = is_fg ? fg_index : bg_index;
+            if (index >= 0) set_colour_index(px, py, index);
+        }
+    }
+}
+
+/**
+ * record the colours of an area that has just been drawn with a mask of the pixels written. pixels lit in the
+ * mask get the foreground colour and the others the background colour, so a transparent background leaves
+ * the pixels that weren't drawn as they were
+ * @param mask - the primitive drawn on its own in lit on unlit
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void colour_mask(const FrameBuffer *mask, int x, int y, int w, int h) {
+    int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    int x1 = x + w > DISPLAY_WIDTH ? DISPLAY_WIDTH : x + w;
+    int y1 = y + h > DISPLAY_HEIGHT ? DISPLAY_HEIGHT : y + h;
+
+    for (int py = y0; py < y1; py++) {
+        for (int px = x0; px < x1; px++) {
+            int index = fbGetPixel(mask, px, py) ? fg_index : bg_index;
+            if (index >= 0) set_colour_index(px, py, index);
+        }
+    }
+}
+
+/**
+ * record the colour of the pixels of a line that has just been drawn
+ * @param x0
+ * @param y0
+ * @param x1
+ * @param y1
+ */
+void colour_line(int x0, int y0, int x1, int y1) {
+    if (!oled_coloured || fg_index < 0) return;
+
+    // draw the line on its own to find its pixels
+    FrameBuffer line = {.fg = FbLit, .bg = FbUnlit};
+    fbLine(&line, x0, y0, x1, y1);
+
+    for (int y = (y0 < y1 ? y0 : y1); y <= (y0 < y1 ? y1 : y0); y++) {
+        for (int x = (x0 < x1 ? x0 : x1); x <= (x0 < x1 ? x1 : x0); x++) {
+            if (fbGetPixel(&line, x, y)) set_colour_index(x, y, fg_index);
+        }
+    }
+}
+
 /**
  * sleep for a number of milliseconds (posix sleep() is seconds)
  * @param msec
@@ -347,6 +278,39 @@ int msleep(long msec) {
     return res;
 }
 
+/**
+ * in the JavaFX version the preparation runs while the GUI starts
+ * @param prepare - the preparation function, NULL for none
+ */
+void jniPrepare(void (*prepare)()) {
+    prepare_function = prepare;
+}
+
+/**
+ * there are no JNI calls in this version so there are no statistics to write
+ * @param filename
+ * @param json
+ */
+void jniStats(char *filename, bool json) {
+    (void)filename;
+    (void)json;
+    printf("GUI: jniStats() no JNI calls in the debug version\n");
+    ssdReport(&oled_ssd, stdout);
+}
+
+/**
+ * running totals since startup. there are no jni calls in the debug version
+ * @param counts
+ */
+void jniCounts(JniCounts *counts) {
+    counts->frames = display_frames;
+    counts->display_commands = display_commands;
+    counts->jni_calls = 0;
+}
+
+void jniStatsReset() {
+}
+
 /**
  * for the java FX version this will setup the JNI environment
  * and locates the Java classes and methods required
@@ -355,6 +319,10 @@ int msleep(long msec) {
  */
 int jniSetup() {
     printf("GUI: jniSetup()\n");
+    ssdInit(&oled_ssd, SSD_BUS_HZ);
+    if (prepare_function != NULL) {
+        prepare_function(); // nothing to overlap with here
+    }
     userProcessing();
     return 0;
 }
@@ -369,6 +337,20 @@ int javaFx() {
     return 0;
 }
 
+/**
+ * the mock up is single threaded so commands are always handled immediately
+ * @param enable - not used
+ */
+void jniAsync(bool enable) {
+    (void)enable;
+}
+
+/**
+ * the mock up is single threaded so there are never any commands waiting
+ */
+void jniFence() {
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Motor functions
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -404,9 +386,11 @@ void motorStep() {
 /**
  * create an svg file for the mock up display output file provided
  * @param output_filename
+ * @return false if the file couldn't be created
  */
-void create_svg_file_header(char * output_filename) {
+bool create_svg_file_header(char * output_filename) {
     output_file = fopen(output_filename, "w");
+    if (output_file == NULL) return false;
 
     // size of graphic
     fprintf(output_file, "<svg width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\">\n",
@@ -416,49 +400,285 @@ void create_svg_file_header(char * output_filename) {
     fprintf(output_file,
             "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" style=\"fill:%s;\" />\n",
             0, 0, (DISPLAY_WIDTH+2)*DISPLAY_SCALE, (DISPLAY_HEIGHT+2)*DISPLAY_SCALE, "GREY");
+    return true;
 }
 
+
 /**
  * create the svg footer
+ * @return false if the file couldn't be written
  */
 // create a function to create an svg file footer and write it to the given file
-void create_svg_file_footer() {
+bool create_svg_file_footer() {
     fprintf(output_file, "</svg>\n");
-    fclose(output_file);
+    return fclose(output_file) == 0;
 }
 
 /**
  * draw the display as an svg file
+ * @param snapshot
  */
-void output_display_svg(){
+void output_display_svg(const SvgSnapshot *snapshot){
     for (int col = 0; col<DISPLAY_WIDTH; col++){
         for (int row = 0; row<DISPLAY_HEIGHT; row++){
             fprintf(output_file,
                     "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
                     "style=\"fill:%s;stroke-width:%s;stroke:rgb(0,0,0)\" />\n",
                     (col+1)*DISPLAY_SCALE, (row+1)*DISPLAY_SCALE, DISPLAY_SCALE, DISPLAY_SCALE,
-                    oled[col][row], SVG_STROKE_WIDTH );
+                    snapshot->coloured ? snapshot->palette[colour_index(snapshot->colours, col, row)] :
+                    fbGetPixel(&snapshot->fb, col, row) ? SVG_LIT_COLOUR : SVG_UNLIT_COLOUR, SVG_STROKE_WIDTH );
         }
     }
 }
 
+/**
+ * write a snapshot to the svg file. it is written to a temporary file first and renamed so that the browser
+ * never reads a partly written file
+ * @param snapshot
+ */
+void write_svg(const SvgSnapshot *snapshot) {
+    if (!create_svg_file_header(DISPLAY_SVG_TEMP_FILENAME)) {
+        printf("GUI: can't create %s\n", DISPLAY_SVG_TEMP_FILENAME);
+        return;
+    }
+    output_display_svg(snapshot);
+    if (!create_svg_file_footer() || rename(DISPLAY_SVG_TEMP_FILENAME, DISPLAY_SVG_FILENAME) != 0) {
+        printf("GUI: can't write %s\n", DISPLAY_SVG_FILENAME);
+    }
+}
+
+/**
+ * FNV-1a hash of what a snapshot shows, to find frames that are the same as the last one written
+ * @param snapshot
+ * @return hash
+ */
+uint64_t svg_hash(const SvgSnapshot *snapshot) {
+    uint64_t hash = 14695981039346656037ULL;
+    const uint8_t *bytes = &snapshot->fb.pages[0][0];
+    for (size_t i = 0; i < sizeof(snapshot->fb.pages); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    if (snapshot->coloured) {
+        bytes = &snapshot->colours[0][0];
+        for (size_t i = 0; i < sizeof(snapshot->colours); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        for (int i = 0; i < snapshot->palette_count; i++) {
+            for (const char *c = snapshot->palette[i]; *c != '\0'; c++) {
+                hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+            }
+            hash = (hash ^ 0) * 1099511628211ULL; // so "ab","c" differs from "a","bc"
+        }
+    }
+    return hash;
+}
+
+/**
+ * the svg writer thread. writes the latest snapshot, no sooner than 1/svg_fps seconds after the last file
+ * @param unused
+ * @return NULL
+ */
+void *svg_writer(void *unused) {
+    (void)unused;
+    bool written = false;
+    uint64_t written_hash = 0;
+    long long written_ns = 0;
+
+    pthread_mutex_lock(&svg_mutex);
+    for (;;) {
+        while (!svg_pending && !svg_stopping) {
+            pthread_cond_wait(&svg_cond, &svg_mutex);
+        }
+        if (!svg_pending) break;
+
+        // keep to the write rate. snapshots left while waiting replace this one
+        long long due_ns = written && svg_fps > 0 ? written_ns + 1000000000LL / svg_fps : 0;
+        long long now = statsNow();
+        if (!svg_stopping && now < due_ns) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            long long wait_ns = deadline.tv_nsec + (due_ns - now);
+            deadline.tv_sec += wait_ns / 1000000000LL;
+            deadline.tv_nsec = wait_ns % 1000000000LL;
+            pthread_cond_timedwait(&svg_cond, &svg_mutex, &deadline);
+            continue;
+        }
+
+        svg_writing = svg_next;
+        svg_pending = false;
+        pthread_mutex_unlock(&svg_mutex);
+
+        uint64_t hash = svg_hash(&svg_writing);
+        bool unchanged = written && hash == written_hash;
+        if (!unchanged) {
+            write_svg(&svg_writing);
+            written = true;
+            written_hash = hash;
+            written_ns = statsNow();
+        }
+
+        pthread_mutex_lock(&svg_mutex);
+        if (unchanged) svg_unchanged++; else svg_written++;
+    }
+    pthread_mutex_unlock(&svg_mutex);
+    return NULL;
+}
+
+/**
+ * write the last snapshot and stop the writer thread. called at exit
+ */
+void svg_writer_stop() {
+    pthread_mutex_lock(&svg_mutex);
+    if (!svg_started) {
+        pthread_mutex_unlock(&svg_mutex);
+        return;
+    }
+    svg_stopping = true;
+    pthread_cond_signal(&svg_cond);
+    pthread_mutex_unlock(&svg_mutex);
+
+    pthread_join(svg_thread, NULL);
+    svg_started = false;
+    printf("GUI: %s written %lu times, %lu frames replaced by later ones, %lu unchanged frames skipped\n",
+           DISPLAY_SVG_FILENAME, svg_written, svg_replaced, svg_unchanged);
+}
+
+/**
+ * start the writer thread
+ * @return false if it couldn't be started, the file is then written straight away
+ */
+bool svg_writer_start() {
+    char *env_fps = getenv(SVG_FPS_ENV);
+    if (env_fps != NULL) {
+        svg_fps = atoi(env_fps);
+        svg_fps_fixed = true;
+    }
+
+    if (pthread_create(&svg_thread, NULL, svg_writer, NULL) != 0) {
+        printf("GUI: can't start the svg writer thread\n");
+        return false;
+    }
+    svg_started = true;
+    atexit(svg_writer_stop);
+    return true;
+}
+
 /**
  * output the display to an svg file
  */
 void saveDisplay(){
-    create_svg_file_header(DISPLAY_SVG_FILENAME);
-    output_display_svg();
-    create_svg_file_footer();
+    static bool start_tried = false;
+    FbRegion regions[FB_PAGES];
+    // a change of colour alone doesn't change the framebuffer
+    if (fbPresent(&oled_presenter, &oled, regions) == 0 && !oled_colours_changed) return;
+    oled_colours_changed = false;
+    display_frames++;
+
+    long long bus_ns = ssdUpdate(&oled_ssd, &oled);
+    if (bus_ns > 0) {
+        printf("GUI: SSD1306 frame %zu i2c bytes, %.2f ms on the bus\n", oled_ssd.last_bytes, bus_ns / 1e6);
+    }
+
+    if (!start_tried) {
+        start_tried = true;
+        svg_writer_start();
+    }
+
+    pthread_mutex_lock(&svg_mutex);
+    svg_next.fb = oled;
+    svg_next.coloured = oled_coloured;
+    if (oled_coloured) {
+        memcpy(svg_next.colours, oled_colours, sizeof(oled_colours));
+        memcpy(svg_next.palette, palette, sizeof(palette));
+        svg_next.palette_count = palette_count;
+    }
+    if (svg_pending) svg_replaced++;
+    svg_pending = true;
+
+    if (svg_started) {
+        pthread_cond_signal(&svg_cond);
+        pthread_mutex_unlock(&svg_mutex);
+    } else {
+        pthread_mutex_unlock(&svg_mutex);
+        svg_pending = false;
+        write_svg(&svg_next);
+    }
+}
+
+/**
+ * output the display to the svg file unless a frame is being drawn
+ * in which case the file is written once by displayEndFrame()
+ */
+void displayChanged(){
+    if (frame_depth == 0) {
+        saveDisplay();
+    }
+}
+
+/**
+ * start a display frame. the svg file is not updated until the matching displayEndFrame()
+ */
+void displayBeginFrame() {
+    frame_depth++;
+}
+
+/**
+ * finish a display frame and output the display to the svg file
+ */
+void displayEndFrame() {
+    if (frame_depth == 0) return;
+
+    frame_depth--;
+    displayChanged();
+}
+
+/**
+ * limit the rate the svg file is written at (unless SVG_FPS_ENV is set). frames drawn sooner replace the one
+ * waiting to be written
+ * @param fps - 0 for no limit
+ */
+void displayFrameRate(int fps) {
+    pthread_mutex_lock(&svg_mutex);
+    if (!svg_fps_fixed) {
+        svg_fps = fps < 0 ? 0 : fps;
+    }
+    pthread_mutex_unlock(&svg_mutex);
+}
+
+/**
+ * turn the display on, dim it or turn it off. turning it off clears it and then nothing is drawn until it is
+ * turned on again
+ * @param power
+ */
+void displayPower(enum DisplayPower power) {
+    if (power == display_power) return;
+
+    printf("GUI: DISPLAY_POWER %d\n", power);
+    if (power == DisplayOff) {
+        displayClear();
+    }
+    display_power = power;
+    ssdPower(&oled_ssd, power != DisplayOff, power == DisplayOn ? SSD_CONTRAST : SSD_CONTRAST_DIMMED);
+}
+
+/**
+ * @return the display power set by displayPower()
+ */
+enum DisplayPower displayPowerState() {
+    return display_power;
 }
 
 /**
  * clear the display
  */
 void displayClear() {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
     printf("GUI: CLEAR_DISPLAY\n");
     //call_j_command(build_args("s", "CLEAR_DISPLAY"));
-    displayClearArea(0,0,DISPLAY_WIDTH, DISPLAY_HEIGHT);
-    saveDisplay();
+    fbClear(&oled);
+    colour_area(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    displayChanged();
 }
 
 /**
@@ -469,25 +689,83 @@ void displayClear() {
  * @param h height of area to clear in pixels
  */
 void displayClearArea(int x, int y, int w, int h) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
     printf("GUI: CLEAR_AREA %d %d %d %d\n", x, y, w, h);
     //call_j_command(build_args("sdddd", "CLEAR_AREA", x, y, w, h)); // 1st argument is format specifier
-    for (int col = x; col<(x+w); col++){
-        for (int row = 0; row<(y+h); row++){
-            strncpy(oled[col][row], display_bg, COLOUR_MAX_CHARS);
-        }
+    fbClearArea(&oled, x, y, w, h);
+    colour_area(x, y, w, h);
+    displayChanged();
+}
+
+/**
+ * fill a rectangle with the foreground colour
+ * @param x top left cartesian position x
+ * @param y top left cartesian position y
+ * @param w width of the rectangle in pixels
+ * @param h height of the rectangle in pixels
+ */
+void displayFillRect(int x, int y, int w, int h) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
+    printf("GUI: FILL_RECT %d %d %d %d\n", x, y, w, h);
+    fbFillRect(&oled, x, y, w, h);
+    if (oled_coloured) {
+        FrameBuffer mask = {.fg = FbLit, .bg = FbUnlit};
+        fbFillRect(&mask, x, y, w, h);
+        colour_mask(&mask, x, y, w, h);
     }
+    displayChanged();
 }
 
 /**
- * set a pixel in the display array to a specified colour
- * @param x pixel position cartesian x
- * @param y pixel position cartesian y
- * @param colour - string that specifies the colour and svg colour will work
+ * invert the pixels of a rectangle
+ * @param x top left cartesian position x
+ * @param y top left cartesian position y
+ * @param w width of the area in pixels
+ * @param h height of the area in pixels
  */
-void displayColourPixel(int x, int y, char* colour) {
-    if (x >= 0 && y >= 0 && x < DISPLAY_WIDTH && y < DISPLAY_HEIGHT) {
-        strncpy(oled[x][y], colour, COLOUR_MAX_CHARS);
+void displayInvertArea(int x, int y, int w, int h) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
+    printf("GUI: INVERT_AREA %d %d %d %d\n", x, y, w, h);
+    fbInvertArea(&oled, x, y, w, h);
+    colour_area(x, y, w, h);
+    displayChanged();
+}
+
+/**
+ * display text in inverse video
+ * @param x
+ * @param y
+ * @param text
+ * @param size
+ */
+void displayTextInverse(int x, int y, char *text, int size) {
+    displayText(x, y, text, size);
+    displayInvertArea(x, y, (int)strlen(text) * FB_CHAR_WIDTH * size, FB_CHAR_HEIGHT * size);
+}
+
+/**
+ * draw a 1 bit per pixel image, set bits in the foreground colour and clear bits in the background colour
+ * @param x top left cartesian position x
+ * @param y top left cartesian position y
+ * @param w width of the image in pixels
+ * @param h height of the image in pixels
+ * @param bits (w + 7) / 8 bytes per row, the leftmost pixel in the top bit of the first byte
+ */
+void displayBitmap(int x, int y, int w, int h, const unsigned char *bits) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
+    printf("GUI: BITMAP %d %d %d %d\n", x, y, w, h);
+    if (w <= 0 || h <= 0 || bits == NULL) return;
+    fbBitmap(&oled, x, y, w, h, bits);
+    if (oled_coloured) {
+        FrameBuffer mask = {.fg = FbLit, .bg = FbUnlit};
+        fbBitmap(&mask, x, y, w, h, bits);
+        colour_mask(&mask, x, y, w, h);
     }
+    displayChanged();
 }
 
 /**
@@ -499,52 +777,15 @@ void displayColourPixel(int x, int y, char* colour) {
  * @param y1 pixel position end of line cartesian y
  */
 void displayLine(int x0, int y0, int x1, int y1) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
     printf("GUI: LINE %d %d %d %d\n", x0, y0, x1, y1);
     //call_j_command(build_args("sdddd", "LINE", x, y, w, h)); // 1st argument is format specifier
 
-    // bresenham's algorithm for the pixels on a straight line - thx Wikpedia
-    bool steep = abs(y1 - y0) > abs(x1 - x0);
-    int t;
-
-    if (steep) {
-        t = x0; x0 = y0; y0 = t; //swap(x0, y0);
-        t = x1; x1 = y1; y1 = t; //swap(x1, y1);
-    }
-
-    if (x0 > x1) {
-        t = x0; x0=x1; x1=t; //swap(x0, x1);
-        t = y0; y0=y1; y1=t; //swap(y0, y1);
-    }
-
-    int dx, dy;
-    dx = x1 - x0;
-    dy = abs(y1 - y0);
+    fbLine(&oled, x0, y0, x1, y1);
+    colour_line(x0, y0, x1, y1);
 
-    int err = dx / 2;
-    int ystep;
-
-    if (y0 < y1) {
-        ystep = 1;
-    } else {
-        ystep = -1;
-    }
-
-    for (; x0 <= x1; x0++) {
-        if (steep) {
-            displayColourPixel(y0, x0, display_fg);
-        } else {
-            displayColourPixel(x0, y0, display_fg);
-        }
-
-        err -= dy;
-
-        if (err < 0) {
-            y0 += ystep;
-            err += dx;
-        }
-    }
-
-    saveDisplay();
+    displayChanged();
 }
 
 /**
@@ -554,49 +795,14 @@ void displayLine(int x0, int y0, int x1, int y1) {
  * @param y
  */
 void displayPixel(int x, int y) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
     printf("GUI: PIXEL %d %d\n", x, y);
     //call_j_command(build_args("sdd", "PIXEL", x, y)); // 1st argument is format specifier
-    displayColourPixel(x,y, display_fg);
+    fbPixel(&oled, x, y);
+    colour_line(x, y, x, y);
 
-    saveDisplay();
-}
-
-/**
- * draw a single character on the display
- * @param x pixel position x
- * @param y pixel position y
- * @param c the ASCII character to display
- * @param size
- */
-void drawChar(int x, int y, char c, int size) {
-    // draw the 5 pixel columns
-    for (int column=0; column<6; column++ ) {
-        // lookup pixels for row of character
-        int line = 0;
-        if (column != 5) {
-            line = BASIC_FONT[((int)c*5)+column];
-        }
-
-        char* colour;
-
-        // draw the 8 pixels in row
-        for (int row = 0; row<8; row++) {
-
-            colour = ((line & 0x1) == 1) ? display_fg : display_bg;
-
-            if ((strlen(colour)!=0)) { // if the colour isn't empty string
-                for (int w = 0; w < size; w++) {
-                    for (int h = 0; h < size; h++) {
-                        displayColourPixel(x + column*size +w, y + row*size +h, colour);
-                    }
-                }
-            }
-
-            // next pixel
-            line >>= 1;
-        }
-
-    }
+    displayChanged();
 }
 
 /**
@@ -607,13 +813,20 @@ void drawChar(int x, int y, char c, int size) {
  * @param size - 1 or 2 are the only two sizes currently supported on the real display
  */
 void displayText(int x, int y, char *text, int size) {
+    if (display_power == DisplayOff) return; // nothing is drawn while the display is off
+    display_commands++;
     printf("GUI: TEXTXY %d %d %s %d\n", x, y, text, size);
     //call_j_command(build_args("sddsd", "TEXTXY", x, y, text, size)); // 1st argument is format specifier
-    for (int i = 0; i<strlen(text); i++){
-        drawChar(x+(i*6*size), y, *(text+i), size);
+    fbText(&oled, x, y, text, size);
+    if (oled_coloured) {
+        // only the glyphs are drawn over a transparent background
+        FrameBuffer mask = {.fg = FbLit, .bg = FbUnlit};
+        fbText(&mask, x, y, text, size);
+        int scale = size < 1 ? 1 : size;
+        colour_mask(&mask, x, y, (int)strlen(text) * FB_CHAR_WIDTH * scale, FB_CHAR_HEIGHT * scale);
     }
 
-    saveDisplay();
+    displayChanged();
 }
 
 /**
@@ -628,8 +841,13 @@ void displayText(int x, int y, char *text, int size) {
  */
 void displayColour(char *fg, char *bg) {
     printf("GUI: MESSAGE %s %s\n", fg, bg);
-    strncpy(display_fg, fg, COLOUR_MAX_CHARS);
-    strncpy(display_bg, bg, COLOUR_MAX_CHARS);
+    fbColour(&oled, fg, bg);
+
+    fg_index = palette_index(fg, fbInk(fg));
+    bg_index = palette_index(bg, fbInk(bg));
+    if (!oled_coloured && (fg_index > PALETTE_LIT || bg_index > PALETTE_LIT)) {
+        start_colours();
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -664,6 +882,31 @@ char *buttonState() {
     return result;
 }
 
+/**
+ * ask the user for a button press
+ * @return
+ */
+enum ButtonEvent buttonPollEvent() {
+    char *state = buttonState();
+    enum ButtonEvent event = NoPress;
+
+    if (strcmp(state, "SHORT_PRESS") == 0) event = ShortPress;
+    if (strcmp(state, "LONG_PRESS") == 0) event = LongPress;
+
+    free(state);
+    return event;
+}
+
+/**
+ * ask the user for a button press. the console input waits for the user so there is no timeout
+ * @param timeout - not used
+ * @return
+ */
+enum ButtonEvent buttonWaitEvent(long timeout) {
+    (void)timeout;
+    return buttonPollEvent();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // CLOCK FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,707 @@
+/**
+ * Framebuffer and rasterizer for the 128x64 OLED display
+ * see fish_fb.h for the memory layout
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "fish.h"
+#include "fish_fb.h"
+#include "fish_fbk.h"
+
+#define FONT_CHARS 255 // characters in BASIC_FONT, each is 5 columns of 8 pixels (bit 0 at the top)
+
+// the character font for the display
+const unsigned char BASIC_FONT[] = {
+        0x00, 0x00, 0x00, 0x00, 0x00,
+        0x3E, 0x5B, 0x4F, 0x5B, 0x3E,
+        0x3E, 0x6B, 0x4F, 0x6B, 0x3E,
+        0x1C, 0x3E, 0x7C, 0x3E, 0x1C,
+        0x18, 0x3C, 0x7E, 0x3C, 0x18,
+        0x1C, 0x57, 0x7D, 0x57, 0x1C,
+        0x1C, 0x5E, 0x7F, 0x5E, 0x1C,
+        0x00, 0x18, 0x3C, 0x18, 0x00,
+        0xFF, 0xE7, 0xC3, 0xE7, 0xFF,
+        0x00, 0x18, 0x24, 0x18, 0x00,
+        0xFF, 0xE7, 0xDB, 0xE7, 0xFF,
+        0x30, 0x48, 0x3A, 0x06, 0x0E,
+        0x26, 0x29, 0x79, 0x29, 0x26,
+        0x40, 0x7F, 0x05, 0x05, 0x07,
+        0x40, 0x7F, 0x05, 0x25, 0x3F,
+        0x5A, 0x3C, 0xE7, 0x3C, 0x5A,
+        0x7F, 0x3E, 0x1C, 0x1C, 0x08,
+        0x08, 0x1C, 0x1C, 0x3E, 0x7F,
+        0x14, 0x22, 0x7F, 0x22, 0x14,
+        0x5F, 0x5F, 0x00, 0x5F, 0x5F,
+        0x06, 0x09, 0x7F, 0x01, 0x7F,
+        0x00, 0x66, 0x89, 0x95, 0x6A,
+        0x60, 0x60, 0x60, 0x60, 0x60,
+        0x94, 0xA2, 0xFF, 0xA2, 0x94,
+        0x08, 0x04, 0x7E, 0x04, 0x08,
+        0x10, 0x20, 0x7E, 0x20, 0x10,
+        0x08, 0x08, 0x2A, 0x1C, 0x08,
+        0x08, 0x1C, 0x2A, 0x08, 0x08,
+        0x1E, 0x10, 0x10, 0x10, 0x10,
+        0x0C, 0x1E, 0x0C, 0x1E, 0x0C,
+        0x30, 0x38, 0x3E, 0x38, 0x30,
+        0x06, 0x0E, 0x3E, 0x0E, 0x06,
+        0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x5F, 0x00, 0x00,
+        0x00, 0x07, 0x00, 0x07, 0x00,
+        0x14, 0x7F, 0x14, 0x7F, 0x14,
+        0x24, 0x2A, 0x7F, 0x2A, 0x12,
+        0x23, 0x13, 0x08, 0x64, 0x62,
+        0x36, 0x49, 0x56, 0x20, 0x50,
+        0x00, 0x08, 0x07, 0x03, 0x00,
+        0x00, 0x1C, 0x22, 0x41, 0x00,
+        0x00, 0x41, 0x22, 0x1C, 0x00,
+        0x2A, 0x1C, 0x7F, 0x1C, 0x2A,
+        0x08, 0x08, 0x3E, 0x08, 0x08,
+        0x00, 0x80, 0x70, 0x30, 0x00,
+        0x08, 0x08, 0x08, 0x08, 0x08,
+        0x00, 0x00, 0x60, 0x60, 0x00,
+        0x20, 0x10, 0x08, 0x04, 0x02,
+        0x3E, 0x51, 0x49, 0x45, 0x3E,
+        0x00, 0x42, 0x7F, 0x40, 0x00,
+        0x72, 0x49, 0x49, 0x49, 0x46,
+        0x21, 0x41, 0x49, 0x4D, 0x33,
+        0x18, 0x14, 0x12, 0x7F, 0x10,
+        0x27, 0x45, 0x45, 0x45, 0x39,
+        0x3C, 0x4A, 0x49, 0x49, 0x31,
+        0x41, 0x21, 0x11, 0x09, 0x07,
+        0x36, 0x49, 0x49, 0x49, 0x36,
+        0x46, 0x49, 0x49, 0x29, 0x1E,
+        0x00, 0x00, 0x14, 0x00, 0x00,
+        0x00, 0x40, 0x34, 0x00, 0x00,
+        0x00, 0x08, 0x14, 0x22, 0x41,
+        0x14, 0x14, 0x14, 0x14, 0x14,
+        0x00, 0x41, 0x22, 0x14, 0x08,
+        0x02, 0x01, 0x59, 0x09, 0x06,
+        0x3E, 0x41, 0x5D, 0x59, 0x4E,
+        0x7C, 0x12, 0x11, 0x12, 0x7C,
+        0x7F, 0x49, 0x49, 0x49, 0x36,
+        0x3E, 0x41, 0x41, 0x41, 0x22,
+        0x7F, 0x41, 0x41, 0x41, 0x3E,
+        0x7F, 0x49, 0x49, 0x49, 0x41,
+        0x7F, 0x09, 0x09, 0x09, 0x01,
+        0x3E, 0x41, 0x41, 0x51, 0x73,
+        0x7F, 0x08, 0x08, 0x08, 0x7F,
+        0x00, 0x41, 0x7F, 0x41, 0x00,
+        0x20, 0x40, 0x41, 0x3F, 0x01,
+        0x7F, 0x08, 0x14, 0x22, 0x41,
+        0x7F, 0x40, 0x40, 0x40, 0x40,
+        0x7F, 0x02, 0x1C, 0x02, 0x7F,
+        0x7F, 0x04, 0x08, 0x10, 0x7F,
+        0x3E, 0x41, 0x41, 0x41, 0x3E,
+        0x7F, 0x09, 0x09, 0x09, 0x06,
+        0x3E, 0x41, 0x51, 0x21, 0x5E,
+        0x7F, 0x09, 0x19, 0x29, 0x46,
+        0x26, 0x49, 0x49, 0x49, 0x32,
+        0x03, 0x01, 0x7F, 0x01, 0x03,
+        0x3F, 0x40, 0x40, 0x40, 0x3F,
+        0x1F, 0x20, 0x40, 0x20, 0x1F,
+        0x3F, 0x40, 0x38, 0x40, 0x3F,
+        0x63, 0x14, 0x08, 0x14, 0x63,
+        0x03, 0x04, 0x78, 0x04, 0x03,
+        0x61, 0x59, 0x49, 0x4D, 0x43,
+        0x00, 0x7F, 0x41, 0x41, 0x41,
+        0x02, 0x04, 0x08, 0x10, 0x20,
+        0x00, 0x41, 0x41, 0x41, 0x7F,
+        0x04, 0x02, 0x01, 0x02, 0x04,
+        0x40, 0x40, 0x40, 0x40, 0x40,
+        0x00, 0x03, 0x07, 0x08, 0x00,
+        0x20, 0x54, 0x54, 0x78, 0x40,
+        0x7F, 0x28, 0x44, 0x44, 0x38,
+        0x38, 0x44, 0x44, 0x44, 0x28,
+        0x38, 0x44, 0x44, 0x28, 0x7F,
+        0x38, 0x54, 0x54, 0x54, 0x18,
+        0x00, 0x08, 0x7E, 0x09, 0x02,
+        0x18, 0xA4, 0xA4, 0x9C, 0x78,
+        0x7F, 0x08, 0x04, 0x04, 0x78,
+        0x00, 0x44, 0x7D, 0x40, 0x00,
+        0x20, 0x40, 0x40, 0x3D, 0x00,
+        0x7F, 0x10, 0x28, 0x44, 0x00,
+        0x00, 0x41, 0x7F, 0x40, 0x00,
+        0x7C, 0x04, 0x78, 0x04, 0x78,
+        0x7C, 0x08, 0x04, 0x04, 0x78,
+        0x38, 0x44, 0x44, 0x44, 0x38,
+        0xFC, 0x18, 0x24, 0x24, 0x18,
+        0x18, 0x24, 0x24, 0x18, 0xFC,
+        0x7C, 0x08, 0x04, 0x04, 0x08,
+        0x48, 0x54, 0x54, 0x54, 0x24,
+        0x04, 0x04, 0x3F, 0x44, 0x24,
+        0x3C, 0x40, 0x40, 0x20, 0x7C,
+        0x1C, 0x20, 0x40, 0x20, 0x1C,
+        0x3C, 0x40, 0x30, 0x40, 0x3C,
+        0x44, 0x28, 0x10, 0x28, 0x44,
+        0x4C, 0x90, 0x90, 0x90, 0x7C,
+        0x44, 0x64, 0x54, 0x4C, 0x44,
+        0x00, 0x08, 0x36, 0x41, 0x00,
+        0x00, 0x00, 0x77, 0x00, 0x00,
+        0x00, 0x41, 0x36, 0x08, 0x00,
+        0x02, 0x01, 0x02, 0x04, 0x02,
+        0x3C, 0x26, 0x23, 0x26, 0x3C,
+        0x1E, 0xA1, 0xA1, 0x61, 0x12,
+        0x3A, 0x40, 0x40, 0x20, 0x7A,
+        0x38, 0x54, 0x54, 0x55, 0x59,
+        0x21, 0x55, 0x55, 0x79, 0x41,
+        0x21, 0x54, 0x54, 0x78, 0x41,
+        0x21, 0x55, 0x54, 0x78, 0x40,
+        0x20, 0x54, 0x55, 0x79, 0x40,
+        0x0C, 0x1E, 0x52, 0x72, 0x12,
+        0x39, 0x55, 0x55, 0x55, 0x59,
+        0x39, 0x54, 0x54, 0x54, 0x59,
+        0x39, 0x55, 0x54, 0x54, 0x58,
+        0x00, 0x00, 0x45, 0x7C, 0x41,
+        0x00, 0x02, 0x45, 0x7D, 0x42,
+        0x00, 0x01, 0x45, 0x7C, 0x40,
+        0xF0, 0x29, 0x24, 0x29, 0xF0,
+        0xF0, 0x28, 0x25, 0x28, 0xF0,
+        0x7C, 0x54, 0x55, 0x45, 0x00,
+        0x20, 0x54, 0x54, 0x7C, 0x54,
+        0x7C, 0x0A, 0x09, 0x7F, 0x49,
+        0x32, 0x49, 0x49, 0x49, 0x32,
+        0x32, 0x48, 0x48, 0x48, 0x32,
+        0x32, 0x4A, 0x48, 0x48, 0x30,
+        0x3A, 0x41, 0x41, 0x21, 0x7A,
+        0x3A, 0x42, 0x40, 0x20, 0x78,
+        0x00, 0x9D, 0xA0, 0xA0, 0x7D,
+        0x39, 0x44, 0x44, 0x44, 0x39,
+        0x3D, 0x40, 0x40, 0x40, 0x3D,
+        0x3C, 0x24, 0xFF, 0x24, 0x24,
+        0x48, 0x7E, 0x49, 0x43, 0x66,
+        0x2B, 0x2F, 0xFC, 0x2F, 0x2B,
+        0xFF, 0x09, 0x29, 0xF6, 0x20,
+        0xC0, 0x88, 0x7E, 0x09, 0x03,
+        0x20, 0x54, 0x54, 0x79, 0x41,
+        0x00, 0x00, 0x44, 0x7D, 0x41,
+        0x30, 0x48, 0x48, 0x4A, 0x32,
+        0x38, 0x40, 0x40, 0x22, 0x7A,
+        0x00, 0x7A, 0x0A, 0x0A, 0x72,
+        0x7D, 0x0D, 0x19, 0x31, 0x7D,
+        0x26, 0x29, 0x29, 0x2F, 0x28,
+        0x26, 0x29, 0x29, 0x29, 0x26,
+        0x30, 0x48, 0x4D, 0x40, 0x20,
+        0x38, 0x08, 0x08, 0x08, 0x08,
+        0x08, 0x08, 0x08, 0x08, 0x38,
+        0x2F, 0x10, 0xC8, 0xAC, 0xBA,
+        0x2F, 0x10, 0x28, 0x34, 0xFA,
+        0x00, 0x00, 0x7B, 0x00, 0x00,
+        0x08, 0x14, 0x2A, 0x14, 0x22,
+        0x22, 0x14, 0x2A, 0x14, 0x08,
+        0xAA, 0x00, 0x55, 0x00, 0xAA,
+        0xAA, 0x55, 0xAA, 0x55, 0xAA,
+        0x00, 0x00, 0x00, 0xFF, 0x00,
+        0x10, 0x10, 0x10, 0xFF, 0x00,
+        0x14, 0x14, 0x14, 0xFF, 0x00,
+        0x10, 0x10, 0xFF, 0x00, 0xFF,
+        0x10, 0x10, 0xF0, 0x10, 0xF0,
+        0x14, 0x14, 0x14, 0xFC, 0x00,
+        0x14, 0x14, 0xF7, 0x00, 0xFF,
+        0x00, 0x00, 0xFF, 0x00, 0xFF,
+        0x14, 0x14, 0xF4, 0x04, 0xFC,
+        0x14, 0x14, 0x17, 0x10, 0x1F,
+        0x10, 0x10, 0x1F, 0x10, 0x1F,
+        0x14, 0x14, 0x14, 0x1F, 0x00,
+        0x10, 0x10, 0x10, 0xF0, 0x00,
+        0x00, 0x00, 0x00, 0x1F, 0x10,
+        0x10, 0x10, 0x10, 0x1F, 0x10,
+        0x10, 0x10, 0x10, 0xF0, 0x10,
+        0x00, 0x00, 0x00, 0xFF, 0x10,
+        0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x10, 0xFF, 0x10,
+        0x00, 0x00, 0x00, 0xFF, 0x14,
+        0x00, 0x00, 0xFF, 0x00, 0xFF,
+        0x00, 0x00, 0x1F, 0x10, 0x17,
+        0x00, 0x00, 0xFC, 0x04, 0xF4,
+        0x14, 0x14, 0x17, 0x10, 0x17,
+        0x14, 0x14, 0xF4, 0x04, 0xF4,
+        0x00, 0x00, 0xFF, 0x00, 0xF7,
+        0x14, 0x14, 0x14, 0x14, 0x14,
+        0x14, 0x14, 0xF7, 0x00, 0xF7,
+        0x14, 0x14, 0x14, 0x17, 0x14,
+        0x10, 0x10, 0x1F, 0x10, 0x1F,
+        0x14, 0x14, 0x14, 0xF4, 0x14,
+        0x10, 0x10, 0xF0, 0x10, 0xF0,
+        0x00, 0x00, 0x1F, 0x10, 0x1F,
+        0x00, 0x00, 0x00, 0x1F, 0x14,
+        0x00, 0x00, 0x00, 0xFC, 0x14,
+        0x00, 0x00, 0xF0, 0x10, 0xF0,
+        0x10, 0x10, 0xFF, 0x10, 0xFF,
+        0x14, 0x14, 0x14, 0xFF, 0x14,
+        0x10, 0x10, 0x10, 0x1F, 0x00,
+        0x00, 0x00, 0x00, 0xF0, 0x10,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+        0xFF, 0xFF, 0xFF, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0xFF, 0xFF,
+        0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+        0x38, 0x44, 0x44, 0x38, 0x44,
+        0x7C, 0x2A, 0x2A, 0x3E, 0x14,
+        0x7E, 0x02, 0x02, 0x06, 0x06,
+        0x02, 0x7E, 0x02, 0x7E, 0x02,
+        0x63, 0x55, 0x49, 0x41, 0x63,
+        0x38, 0x44, 0x44, 0x3C, 0x04,
+        0x40, 0x7E, 0x20, 0x1E, 0x20,
+        0x06, 0x02, 0x7E, 0x02, 0x02,
+        0x99, 0xA5, 0xE7, 0xA5, 0x99,
+        0x1C, 0x2A, 0x49, 0x2A, 0x1C,
+        0x4C, 0x72, 0x01, 0x72, 0x4C,
+        0x30, 0x4A, 0x4D, 0x4D, 0x30,
+        0x30, 0x48, 0x78, 0x48, 0x30,
+        0xBC, 0x62, 0x5A, 0x46, 0x3D,
+        0x3E, 0x49, 0x49, 0x49, 0x00,
+        0x7E, 0x01, 0x01, 0x01, 0x7E,
+        0x2A, 0x2A, 0x2A, 0x2A, 0x2A,
+        0x44, 0x44, 0x5F, 0x44, 0x44,
+        0x40, 0x51, 0x4A, 0x44, 0x40,
+        0x40, 0x44, 0x4A, 0x51, 0x40,
+        0x00, 0x00, 0xFF, 0x01, 0x03,
+        0xE0, 0x80, 0xFF, 0x00, 0x00,
+        0x08, 0x08, 0x6B, 0x6B, 0x08,
+        0x36, 0x12, 0x36, 0x24, 0x36,
+        0x06, 0x0F, 0x09, 0x0F, 0x06,
+        0x00, 0x00, 0x18, 0x18, 0x00,
+        0x00, 0x00, 0x10, 0x10, 0x00,
+        0x30, 0x40, 0xFF, 0x01, 0x01,
+        0x00, 0x1F, 0x01, 0x01, 0x1E,
+        0x00, 0x19, 0x1D, 0x17, 0x12,
+        0x00, 0x3C, 0x3C, 0x3C, 0x3C,
+        0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+_Static_assert(sizeof(BASIC_FONT) == FONT_CHARS * 5, "5 bytes per character");
+
+// font columns scaled up for the larger text sizes. each bit of a font column byte is repeated size times,
+// giving a column mask 8 * size pixels high. the masks are constant expressions so the compiler builds the
+// tables, one entry for each possible column byte
+#define FONT_MAX_SCALE 4 // larger text is drawn a font pixel at a time
+#define FONT_RUN(s) ((1u << (s)) - 1)
+#define FONT_BIT(b, i, s) ((((uint32_t)(b) >> (i)) & 1u) * FONT_RUN(s) << ((i) * (s)))
+#define FONT_SPREAD(b, s) (FONT_BIT(b, 0, s) | FONT_BIT(b, 1, s) | FONT_BIT(b, 2, s) | FONT_BIT(b, 3, s) | \
+                           FONT_BIT(b, 4, s) | FONT_BIT(b, 5, s) | FONT_BIT(b, 6, s) | FONT_BIT(b, 7, s))
+#define FONT_X4(s, b) FONT_SPREAD(b, s), FONT_SPREAD((b) + 1, s), FONT_SPREAD((b) + 2, s), FONT_SPREAD((b) + 3, s)
+#define FONT_X16(s, b) FONT_X4(s, b), FONT_X4(s, (b) + 4), FONT_X4(s, (b) + 8), FONT_X4(s, (b) + 12)
+#define FONT_X64(s, b) FONT_X16(s, b), FONT_X16(s, (b) + 16), FONT_X16(s, (b) + 32), FONT_X16(s, (b) + 48)
+#define FONT_X256(s) FONT_X64(s, 0), FONT_X64(s, 64), FONT_X64(s, 128), FONT_X64(s, 192)
+
+const uint32_t FONT_SCALED[FONT_MAX_SCALE][256] = {
+        {FONT_X256(1)}, {FONT_X256(2)}, {FONT_X256(3)}, {FONT_X256(4)}
+};
+
+_Static_assert(FONT_SPREAD(0x81, 1) == 0x81, "size 1 is the font column");
+_Static_assert(FONT_SPREAD(0x81, 2) == 0xC003, "each bit doubled");
+_Static_assert(FONT_SPREAD(0xFF, 4) == 0xFFFFFFFF, "32 pixels high at size 4");
+
+/**
+ * set a pixel to an ink, ignoring pixels outside the display
+ * @param fb
+ * @param x
+ * @param y
+ * @param ink
+ */
+void fb_plot(FrameBuffer *fb, int x, int y, enum FbInk ink) {
+    if (x < 0 || y < 0 || x >= FB_WIDTH || y >= FB_HEIGHT || ink == FbTransparent) return;
+
+    uint8_t bit = (uint8_t)(1 << (y & 7));
+    if (ink == FbLit) {
+        fb->pages[y >> 3][x] |= bit;
+    } else {
+        fb->pages[y >> 3][x] &= (uint8_t)~bit;
+    }
+}
+
+/**
+ * set or flip the pixels of a rectangle, clipped to the display
+ * @param fb
+ * @param x
+ * @param y
+ * @param w
+ * @param h
+ * @param ink - FbLit or FbUnlit, ignored when inverting
+ * @param invert - flip every pixel instead of setting it to the ink
+ */
+void fb_area(FrameBuffer *fb, int x, int y, int w, int h, enum FbInk ink, bool invert) {
+    int x1 = x + w;
+    int y1 = y + h;
+
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > FB_WIDTH) x1 = FB_WIDTH;
+    if (y1 > FB_HEIGHT) y1 = FB_HEIGHT;
+    if (x >= x1 || y >= y1 || (ink == FbTransparent && !invert)) return;
+
+    enum FbkOp op = invert ? FbkInvert : (ink == FbLit ? FbkSet : FbkClear);
+
+    // the columns of each page covered get the same mask of up to 8 rows
+    for (int page = y >> 3; page <= (y1 - 1) >> 3; page++) {
+        int top = (page << 3) < y ? y - (page << 3) : 0;
+        int bottom = ((page << 3) + 8) > y1 ? y1 - (page << 3) : 8;
+        uint8_t mask = (uint8_t)((0xFF << top) & (0xFF >> (8 - bottom)));
+
+        fbkSpan(&fb->pages[page][x], (size_t)(x1 - x), mask, op);
+    }
+}
+
+/**
+ * set a rectangle to an ink, clipped to the display
+ * @param fb
+ * @param x
+ * @param y
+ * @param w
+ * @param h
+ * @param ink
+ */
+void fb_fill(FrameBuffer *fb, int x, int y, int w, int h, enum FbInk ink) {
+    fb_area(fb, x, y, w, h, ink, false);
+}
+
+/**
+ * initialise the framebuffer to a blank display with white on black colours
+ * @param fb
+ */
+void fbInit(FrameBuffer *fb) {
+    memset(fb->pages, 0, sizeof(fb->pages));
+    fb->fg = FbLit;
+    fb->bg = FbUnlit;
+}
+
+/**
+ * work out how a colour is drawn on the monochrome display
+ * @param colour - a javaFX colour name or hex string (e.g. "BLACK", "white", "#FFFFFF"), "" for transparent
+ * @return the ink
+ */
+enum FbInk fbInk(const char *colour) {
+    if (colour == NULL || colour[0] == '\0') return FbTransparent;
+
+    if (strcasecmp(colour, "BLACK") == 0) return FbUnlit;
+
+    // hex colours are black if every digit (ignoring any alpha) is 0
+    if (colour[0] == '#' || (colour[0] == '0' && (colour[1] == 'x' || colour[1] == 'X'))) {
+        const char *digits = colour + (colour[0] == '#' ? 1 : 2);
+        size_t length = strlen(digits);
+        if (length == 8) length = 6; // #RRGGBBAA
+        if (length == 4) length = 3; // #RGBA
+
+        for (size_t i = 0; i < length; i++) {
+            if (!isxdigit((unsigned char)digits[i])) return FbLit;
+            if (digits[i] != '0') return FbLit;
+        }
+        return FbUnlit;
+    }
+
+    return FbLit;
+}
+
+/**
+ * set the foreground and background colours
+ * @param fb
+ * @param fg
+ * @param bg
+ */
+void fbColour(FrameBuffer *fb, const char *fg, const char *bg) {
+    fb->fg = fbInk(fg);
+    fb->bg = fbInk(bg);
+
+    // lit on lit would be invisible, show it in inverse video
+    if (fb->fg == FbLit && fb->bg == FbLit) {
+        fb->fg = FbUnlit;
+    }
+}
+
+/**
+ * clear the whole display to the background (unlit if the background is transparent)
+ * @param fb
+ */
+void fbClear(FrameBuffer *fb) {
+    memset(fb->pages, fb->bg == FbLit ? 0xFF : 0x00, sizeof(fb->pages));
+}
+
+/**
+ * clear part of the display to the background (unlit if the background is transparent)
+ * @param fb
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void fbClearArea(FrameBuffer *fb, int x, int y, int w, int h) {
+    fb_fill(fb, x, y, w, h, fb->bg == FbLit ? FbLit : FbUnlit);
+}
+
+/**
+ * fill a rectangle with the foreground colour
+ * @param fb
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void fbFillRect(FrameBuffer *fb, int x, int y, int w, int h) {
+    fb_fill(fb, x, y, w, h, fb->fg);
+}
+
+/**
+ * flip every pixel of a rectangle, e.g. to highlight a menu item
+ * @param fb
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ */
+void fbInvertArea(FrameBuffer *fb, int x, int y, int w, int h) {
+    fb_area(fb, x, y, w, h, FbLit, true);
+}
+
+/**
+ * draw a 1 bit per pixel image. set bits are drawn in the foreground colour and clear bits
+ * in the background colour (so a transparent background only draws the set bits)
+ * @param fb
+ * @param x - top left
+ * @param y
+ * @param w - width in pixels
+ * @param h - height in pixels
+ * @param bits - FB_BITMAP_STRIDE(w) bytes per row, the leftmost pixel in the top bit of the first byte
+ */
+void fbBitmap(FrameBuffer *fb, int x, int y, int w, int h, const uint8_t *bits) {
+    int stride = FB_BITMAP_STRIDE(w);
+
+    for (int row = 0; row < h; row++) {
+        if (y + row < 0 || y + row >= FB_HEIGHT) continue;
+
+        for (int col = 0; col < w; col++) {
+            bool set = (bits[row * stride + (col >> 3)] >> (7 - (col & 7))) & 1;
+            fb_plot(fb, x + col, y + row, set ? fb->fg : fb->bg);
+        }
+    }
+}
+
+/**
+ * set a pixel to the foreground colour
+ * @param fb
+ * @param x
+ * @param y
+ */
+void fbPixel(FrameBuffer *fb, int x, int y) {
+    fb_plot(fb, x, y, fb->fg);
+}
+
+/**
+ * draw a line in the foreground colour
+ * @param fb
+ * @param x0 - start of the line
+ * @param y0
+ * @param x1 - end of the line
+ * @param y1
+ */
+void fbLine(FrameBuffer *fb, int x0, int y0, int x1, int y1) {
+    // bresenham's algorithm for the pixels on a straight line - thx Wikpedia
+    bool steep = abs(y1 - y0) > abs(x1 - x0);
+    int t;
+
+    if (steep) {
+        t = x0; x0 = y0; y0 = t; //swap(x0, y0);
+        t = x1; x1 = y1; y1 = t; //swap(x1, y1);
+    }
+
+    if (x0 > x1) {
+        t = x0; x0=x1; x1=t; //swap(x0, x1);
+        t = y0; y0=y1; y1=t; //swap(y0, y1);
+    }
+
+    int dx = x1 - x0;
+    int dy = abs(y1 - y0);
+    int err = dx / 2;
+    int ystep = (y0 < y1) ? 1 : -1;
+
+    for (; x0 <= x1; x0++) {
+        if (steep) {
+            fb_plot(fb, y0, x0, fb->fg);
+        } else {
+            fb_plot(fb, x0, y0, fb->fg);
+        }
+
+        err -= dy;
+
+        if (err < 0) {
+            y0 += ystep;
+            err += dx;
+        }
+    }
+}
+
+/**
+ * draw a single character a font pixel at a time, for sizes without a scaled font table
+ * @param fb
+ * @param x - top left pixel position
+ * @param y
+ * @param c - the character
+ * @param size - each font pixel is size x size display pixels
+ */
+void fb_char_pixels(FrameBuffer *fb, int x, int y, unsigned char c, int size) {
+    // the 5 font columns then a space
+    for (int column = 0; column < FB_CHAR_WIDTH; column++) {
+        int line = (column < 5) ? BASIC_FONT[c * 5 + column] : 0;
+
+        for (int row = 0; row < FB_CHAR_HEIGHT; row++) {
+            enum FbInk ink = (line & 0x1) ? fb->fg : fb->bg;
+            if (size == 1) {
+                fb_plot(fb, x + column, y + row, ink);
+            } else {
+                fb_fill(fb, x + column * size, y + row * size, size, size, ink);
+            }
+            line >>= 1;
+        }
+    }
+}
+
+/**
+ * draw a single character in the foreground colour on the background colour
+ * each glyph column is a scaled font mask shifted to the row within its page, so a whole column
+ * is written with a few byte operations rather than pixel by pixel
+ * @param fb
+ * @param x - top left pixel position
+ * @param y
+ * @param c - the character
+ * @param size - each font pixel is size x size display pixels
+ */
+void fb_char(FrameBuffer *fb, int x, int y, unsigned char c, int size) {
+    if (c >= FONT_CHARS) c = 0;
+    if (size > FONT_MAX_SCALE) {
+        fb_char_pixels(fb, x, y, c, size);
+        return;
+    }
+
+    // page holding the top row (rounded down for negative y) and the row within it
+    int page = (y >= 0) ? y >> 3 : -((7 - y) >> 3);
+    int shift = y - page * 8;
+    int height = FB_CHAR_HEIGHT * size;
+    int pages = (shift + height + 7) >> 3;
+    uint64_t cell = ((uint64_t)1 << height) - 1;
+
+    for (int column = 0; column < FB_CHAR_WIDTH; column++) {
+        uint64_t glyph = FONT_SCALED[size - 1][(column < 5) ? BASIC_FONT[c * 5 + column] : 0];
+
+        // pixels to light and pixels to clear in this column
+        uint64_t lit = 0;
+        uint64_t unlit = 0;
+        if (fb->fg == FbLit) lit |= glyph;
+        if (fb->fg == FbUnlit) unlit |= glyph;
+        if (fb->bg == FbLit) lit |= cell & ~glyph;
+        if (fb->bg == FbUnlit) unlit |= cell & ~glyph;
+        lit <<= shift;
+        unlit <<= shift;
+
+        for (int dx = 0; dx < size; dx++) {
+            int col = x + column * size + dx;
+            if (col < 0 || col >= FB_WIDTH) continue;
+
+            for (int p = 0; p < pages; p++) {
+                if (page + p < 0 || page + p >= FB_PAGES) continue;
+                uint8_t *byte = &fb->pages[page + p][col];
+                *byte = (uint8_t)((*byte & ~(unlit >> (p * 8))) | (lit >> (p * 8)));
+            }
+        }
+    }
+}
+
+/**
+ * draw a text string
+ * @param fb
+ * @param x - top left pixel position
+ * @param y
+ * @param text
+ * @param size - 1 or 2 on the real display
+ */
+void fbText(FrameBuffer *fb, int x, int y, const char *text, int size) {
+    if (size < 1) size = 1;
+
+    for (int i = 0; text[i] != '\0'; i++) {
+        int left = x + i * FB_CHAR_WIDTH * size;
+        if (left >= FB_WIDTH) break;
+        fb_char(fb, left, y, (unsigned char)text[i], size);
+    }
+}
+
+/**
+ * @param fb
+ * @param x
+ * @param y
+ * @return true if the pixel is lit, false if unlit or outside the display
+ */
+bool fbGetPixel(const FrameBuffer *fb, int x, int y) {
+    if (x < 0 || y < 0 || x >= FB_WIDTH || y >= FB_HEIGHT) return false;
+    return (fb->pages[y >> 3][x] >> (y & 7)) & 1;
+}
+
+/**
+ * find the changed columns of each page since the frame last presented and record this frame as shown
+ * @param presenter
+ * @param fb
+ * @param regions - receives up to FB_PAGES regions
+ * @return the number of regions, 0 if the display hasn't changed
+ */
+int fbPresent(FbPresenter *presenter, const FrameBuffer *fb, FbRegion *regions) {
+    int count = 0;
+
+    for (int page = 0; page < FB_PAGES; page++) {
+        size_t first = 0;
+        size_t last = FB_WIDTH - 1;
+
+        if (presenter->valid && !fbkDiff(fb->pages[page], presenter->shown[page], FB_WIDTH, &first, &last)) {
+            continue; // page unchanged
+        }
+
+        regions[count].page = page;
+        regions[count].x = (int)first;
+        regions[count].width = (int)(last - first + 1);
+        presenter->bytes += (unsigned long)regions[count].width;
+        count++;
+    }
+
+    if (count == 0) {
+        presenter->unchanged++;
+    } else {
+        memcpy(presenter->shown, fb->pages, sizeof(presenter->shown));
+        presenter->valid = true;
+        presenter->frames++;
+    }
+
+    return count;
+}
+
+/**
+ * forget what the display is showing so the next present sends everything
+ * @param presenter
+ */
+void fbInvalidate(FbPresenter *presenter) {
+    presenter->valid = false;
+}
+
+/**
+ * pack dirty regions for sending. each region is its page, x and width (one byte each, a width of 0
+ * meaning 128) followed by width bytes of pixel data from the page. see fish_fb.h for the format
+ * @param fb
+ * @param regions
+ * @param count
+ * @param out - at least FB_UPDATE_SIZE bytes
+ * @return the packed length in bytes
+ */
+size_t fbPackRegions(const FrameBuffer *fb, const FbRegion *regions, int count, uint8_t *out) {
+    size_t length = 0;
+
+    for (int i = 0; i < count; i++) {
+        // java reads the width as a signed byte, where 128 would arrive as -128, so a whole page is sent as width 0
+        out[length++] = (uint8_t)regions[i].page;
+        out[length++] = (uint8_t)regions[i].x;
+        out[length++] = (uint8_t)(regions[i].width == FB_WIDTH ? 0 : regions[i].width);
+        memcpy(out + length, &fb->pages[regions[i].page][regions[i].x], (size_t)regions[i].width);
+        length += (size_t)regions[i].width;
+    }
+
+    return length;
+}
@@ -0,0 +1,84 @@
+/*
+ * 128x64 1 bit per pixel framebuffer and rasterizer for the OLED display, shared by every backend.
+ *
+ * The memory is in SSD1306 page layout, the same as the real display controller RAM:
+ * 8 pages of 128 bytes, byte x of page p holds the pixels (x, p*8) to (x, p*8+7) with
+ * the top pixel in bit 0. A set bit is a lit pixel.
+ *
+ * The display colours are mapped to lit/unlit pixels: black is unlit, an empty string is
+ * transparent and any other colour is lit. When the foreground and background are both lit
+ * (e.g. white text on a blue highlight) the foreground is drawn unlit, i.e. inverse video,
+ * which is how the monochrome display would show it.
+ */
+#ifndef FISH_FB_H
+#define FISH_FB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FB_WIDTH 128
+#define FB_HEIGHT 64
+#define FB_PAGES (FB_HEIGHT / 8)
+#define FB_SIZE (FB_PAGES * FB_WIDTH) // 1024 bytes
+#define FB_CHAR_WIDTH 6 // 5 font columns and a space, multiplied by the text size
+#define FB_CHAR_HEIGHT 8
+
+// how a colour is drawn
+enum FbInk {FbTransparent = -1, FbUnlit = 0, FbLit = 1};
+
+typedef struct frameBuffer {
+    uint8_t pages[FB_PAGES][FB_WIDTH];
+    enum FbInk fg; // current foreground and background ink
+    enum FbInk bg;
+} FrameBuffer;
+
+void fbInit(FrameBuffer *fb); // blank display, white on black
+enum FbInk fbInk(const char *colour); // the ink used to draw a colour name or hex string
+void fbColour(FrameBuffer *fb, const char *fg, const char *bg);
+void fbClear(FrameBuffer *fb); // clear the whole display to the background
+void fbClearArea(FrameBuffer *fb, int x, int y, int w, int h); // clear to the background
+void fbPixel(FrameBuffer *fb, int x, int y); // in the foreground
+void fbLine(FrameBuffer *fb, int x0, int y0, int x1, int y1); // in the foreground
+void fbText(FrameBuffer *fb, int x, int y, const char *text, int size); // foreground on background
+bool fbGetPixel(const FrameBuffer *fb, int x, int y); // true if lit. false outside the display
+void fbFillRect(FrameBuffer *fb, int x, int y, int w, int h); // in the foreground
+void fbInvertArea(FrameBuffer *fb, int x, int y, int w, int h); // lit pixels become unlit and unlit become lit
+
+// 1bpp bitmaps are rows of bytes, the leftmost pixel of each row in the top bit of its first byte
+#define FB_BITMAP_STRIDE(w) (((w) + 7) / 8) // bytes per row
+#define FB_BITMAP_SIZE(w, h) (FB_BITMAP_STRIDE(w) * (h))
+void fbBitmap(FrameBuffer *fb, int x, int y, int w, int h, const uint8_t *bits); // set bits fg, clear bits bg
+
+// dirty region presentation. the frame last shown is kept so only changed columns of each page need sending
+#define FB_REGION_HEADER 3 // bytes before the pixel data of a packed region: page, x, width
+#define FB_UPDATE_SIZE (FB_PAGES * (FB_REGION_HEADER + FB_WIDTH)) // largest packed update
+
+typedef struct fbRegion {
+    int page;
+    int x; // first changed column
+    int width; // columns from x to the last changed column
+} FbRegion;
+
+typedef struct fbPresenter {
+    uint8_t shown[FB_PAGES][FB_WIDTH]; // what the display is showing
+    bool valid; // false until the first frame has been presented
+    unsigned long frames; // frames presented with changes
+    unsigned long unchanged; // frames that didn't need sending
+    unsigned long bytes; // pixel bytes sent
+} FbPresenter;
+
+// find the changed region of each page since the last present and record the frame as shown.
+// regions needs FB_PAGES entries. returns the number of regions, 0 if nothing changed
+int fbPresent(FbPresenter *presenter, const FrameBuffer *fb, FbRegion *regions);
+void fbInvalidate(FbPresenter *presenter); // the next present sends the whole display
+// pack the regions for the emulator. out needs FB_UPDATE_SIZE bytes. returns the packed length
+// wire format, regions back to back:
+//   byte 0      page 0..FB_PAGES-1
+//   byte 1      x of the first column 0..FB_WIDTH-1
+//   byte 2      width in columns 1..127, or 0 for a whole page (128). java reads bytes signed, so 128
+//               would arrive as -128
+//   width bytes one per column from x, page layout (bit 0 is the top row of the page)
+size_t fbPackRegions(const FrameBuffer *fb, const FbRegion *regions, int count, uint8_t *out);
+
+#endif // FISH_FB_H
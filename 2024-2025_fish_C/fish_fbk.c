@@ -0,0 +1,271 @@
+/**
+ * SIMD framebuffer kernels with a scalar fallback
+ * see fish_fbk.h
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fish_fbk.h"
+
+// the vector kernels need gcc or clang (target attributes and cpu detection) on an x86 processor
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FBK_X86 1
+#include <immintrin.h>
+#endif
+
+struct FbkKernels {
+    const char *name;
+    void (*span)(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op);
+    bool (*diff)(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last);
+};
+
+struct FbkKernels fbk_kernels; // the kernels in use, chosen by fbk_detect()
+pthread_once_t fbk_once = PTHREAD_ONCE_INIT;
+
+/**
+ * apply a mask to a run of bytes a byte at a time
+ * @param bytes
+ * @param n
+ * @param mask
+ * @param op
+ */
+void fbk_span_scalar(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op) {
+    for (size_t i = 0; i < n; i++) {
+        switch (op) {
+            case FbkSet: bytes[i] |= mask; break;
+            case FbkClear: bytes[i] &= (uint8_t)~mask; break;
+            case FbkInvert: bytes[i] ^= mask; break;
+        }
+    }
+}
+
+/**
+ * compare two runs of bytes a byte at a time
+ * @param a
+ * @param b
+ * @param n
+ * @param first - set to the first differing byte
+ * @param last - set to the last differing byte
+ * @return true if any bytes differ
+ */
+bool fbk_diff_scalar(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last) {
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    if (i == n) return false;
+
+    size_t j = n - 1;
+    while (a[j] == b[j]) j--;
+
+    *first = i;
+    *last = j;
+    return true;
+}
+
+#ifdef FBK_X86
+/**
+ * apply a mask to a run of bytes 16 at a time
+ */
+__attribute__((target("sse2")))
+void fbk_span_sse2(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op) {
+    __m128i m = _mm_set1_epi8((char)mask);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+        switch (op) {
+            case FbkSet: v = _mm_or_si128(v, m); break;
+            case FbkClear: v = _mm_andnot_si128(m, v); break;
+            case FbkInvert: v = _mm_xor_si128(v, m); break;
+        }
+        _mm_storeu_si128((__m128i *)(bytes + i), v);
+    }
+    fbk_span_scalar(bytes + i, n - i, mask, op);
+}
+
+/**
+ * compare two runs of bytes 16 at a time
+ */
+__attribute__((target("sse2")))
+bool fbk_diff_sse2(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last) {
+    bool found = false;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                    _mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned int differ = ~(unsigned int)_mm_movemask_epi8(eq) & 0xFFFFu;
+        if (differ != 0) {
+            if (!found) *first = i + (size_t)__builtin_ctz(differ);
+            *last = i + 31 - (size_t)__builtin_clz(differ);
+            found = true;
+        }
+    }
+
+    size_t tail_first, tail_last;
+    if (fbk_diff_scalar(a + i, b + i, n - i, &tail_first, &tail_last)) {
+        if (!found) *first = i + tail_first;
+        *last = i + tail_last;
+        found = true;
+    }
+    return found;
+}
+
+/**
+ * apply a mask to a run of bytes 32 at a time
+ */
+__attribute__((target("avx2")))
+void fbk_span_avx2(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op) {
+    __m256i m = _mm256_set1_epi8((char)mask);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        switch (op) {
+            case FbkSet: v = _mm256_or_si256(v, m); break;
+            case FbkClear: v = _mm256_andnot_si256(m, v); break;
+            case FbkInvert: v = _mm256_xor_si256(v, m); break;
+        }
+        _mm256_storeu_si256((__m256i *)(bytes + i), v);
+    }
+
+    // a half vector then bytes for the rest (calling the sse2 kernel would mix vex and legacy sse code)
+    if (i + 16 <= n) {
+        __m128i h = _mm256_castsi256_si128(m);
+        __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+        switch (op) {
+            case FbkSet: v = _mm_or_si128(v, h); break;
+            case FbkClear: v = _mm_andnot_si128(h, v); break;
+            case FbkInvert: v = _mm_xor_si128(v, h); break;
+        }
+        _mm_storeu_si128((__m128i *)(bytes + i), v);
+        i += 16;
+    }
+    fbk_span_scalar(bytes + i, n - i, mask, op);
+}
+
+/**
+ * compare two runs of bytes 32 at a time
+ */
+__attribute__((target("avx2")))
+bool fbk_diff_avx2(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last) {
+    bool found = false;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                       _mm256_loadu_si256((const __m256i *)(b + i)));
+        unsigned int differ = ~(unsigned int)_mm256_movemask_epi8(eq);
+        if (differ != 0) {
+            if (!found) *first = i + (size_t)__builtin_ctz(differ);
+            *last = i + 31 - (size_t)__builtin_clz(differ);
+            found = true;
+        }
+    }
+
+    if (i + 16 <= n) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                    _mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned int differ = ~(unsigned int)_mm_movemask_epi8(eq) & 0xFFFFu;
+        if (differ != 0) {
+            if (!found) *first = i + (size_t)__builtin_ctz(differ);
+            *last = i + 31 - (size_t)__builtin_clz(differ);
+            found = true;
+        }
+        i += 16;
+    }
+
+    size_t tail_first, tail_last;
+    if (fbk_diff_scalar(a + i, b + i, n - i, &tail_first, &tail_last)) {
+        if (!found) *first = i + tail_first;
+        *last = i + tail_last;
+        found = true;
+    }
+    return found;
+}
+#endif
+
+const struct FbkKernels fbk_available[] = {
+#ifdef FBK_X86
+        {"avx2", fbk_span_avx2, fbk_diff_avx2},
+        {"sse2", fbk_span_sse2, fbk_diff_sse2},
+#endif
+        {"scalar", fbk_span_scalar, fbk_diff_scalar}
+};
+
+/**
+ * @param name
+ * @return true if the processor can run the named kernels
+ */
+bool fbk_supported(const char *name) {
+#ifdef FBK_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+/**
+ * choose the fastest kernels the processor supports
+ */
+void fbk_detect() {
+    for (size_t i = 0; i < sizeof(fbk_available) / sizeof(fbk_available[0]); i++) {
+        if (fbk_supported(fbk_available[i].name)) {
+            fbk_kernels = fbk_available[i];
+            return;
+        }
+    }
+}
+
+/**
+ * apply a bit mask to every byte of a run, e.g. the columns of one page of a rectangle
+ * @param bytes
+ * @param n - number of bytes
+ * @param mask - the bits to set, clear or invert
+ * @param op
+ */
+void fbkSpan(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op) {
+    pthread_once(&fbk_once, fbk_detect);
+    fbk_kernels.span(bytes, n, mask, op);
+}
+
+/**
+ * find the range of bytes that differ between two runs, e.g. a page of two frames
+ * @param a
+ * @param b
+ * @param n - number of bytes
+ * @param first - set to the first differing byte
+ * @param last - set to the last differing byte
+ * @return true if any bytes differ
+ */
+bool fbkDiff(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last) {
+    pthread_once(&fbk_once, fbk_detect);
+    return fbk_kernels.diff(a, b, n, first, last);
+}
+
+/**
+ * @return the name of the kernels in use
+ */
+const char *fbkName() {
+    pthread_once(&fbk_once, fbk_detect);
+    return fbk_kernels.name;
+}
+
+/**
+ * use particular kernels rather than the fastest supported
+ * @param name - "avx2", "sse2" or "scalar"
+ * @return false if the kernels are not available on this processor (the kernels in use are unchanged)
+ */
+bool fbkUse(const char *name) {
+    pthread_once(&fbk_once, fbk_detect);
+
+    for (size_t i = 0; i < sizeof(fbk_available) / sizeof(fbk_available[0]); i++) {
+        if (strcmp(fbk_available[i].name, name) == 0 && fbk_supported(name)) {
+            fbk_kernels = fbk_available[i];
+            return true;
+        }
+    }
+    return false;
+}
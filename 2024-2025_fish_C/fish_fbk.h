@@ -0,0 +1,25 @@
+/*
+ * Bulk kernels for the framebuffer (see fish_fb.h).
+ *
+ * A rectangle in SSD1306 page layout is, for each page it covers, a run of consecutive column bytes
+ * that all get the same bit mask. Filling, clearing and inverting are therefore byte span operations,
+ * and finding what changed between two frames is a span compare. These are done with SSE2 or AVX2
+ * on x86 processors that have them, chosen at run time, and a scalar loop everywhere else.
+ */
+#ifndef FISH_FBK_H
+#define FISH_FBK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum FbkOp {FbkSet, FbkClear, FbkInvert}; // OR, AND NOT or XOR each byte with the mask
+
+void fbkSpan(uint8_t *bytes, size_t n, uint8_t mask, enum FbkOp op);
+// find the first and last byte that differ between a and b. returns false (and leaves first/last) if none do
+bool fbkDiff(const uint8_t *a, const uint8_t *b, size_t n, size_t *first, size_t *last);
+
+const char *fbkName(); // kernels in use: "avx2", "sse2" or "scalar"
+bool fbkUse(const char *name); // choose the kernels (see fish_fbk_bench.c). false if not supported here
+
+#endif // FISH_FBK_H
@@ -0,0 +1,130 @@
+/**
+ * Benchmark of the framebuffer kernels (see fish_fbk.h)
+ *
+ * Each set of kernels this processor supports is chosen in turn with fbkUse(). The SSE2 and AVX2 kernels are
+ * first checked against the scalar ones on random spans, then the framebuffer operations that use them are timed.
+ * build with: cmake --build <build folder> --target fbk_bench
+ * the times are per call, build with optimisation (e.g. -DCMAKE_BUILD_TYPE=Release) for representative numbers
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "fish_fb.h"
+#include "fish_fbk.h"
+
+#define BENCH_CHECKS 200000 // random spans compared against the scalar kernels
+#define BENCH_CALLS 2000000 // calls timed for each operation
+#define BENCH_SPAN 300 // longest span checked, longer than a page so every loop tail is covered
+
+const char *kernel_names[] = {"scalar", "sse2", "avx2"};
+
+/**
+ * @return monotonic time in nanoseconds
+ */
+long long bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * compare the kernels of each supported set with the scalar ones on random spans
+ * @return true if they all agree
+ */
+bool check_kernels() {
+    srand(3);
+
+    for (int check = 0; check < BENCH_CHECKS; check++) {
+        uint8_t a[BENCH_SPAN], b[BENCH_SPAN], expected[BENCH_SPAN], result[BENCH_SPAN];
+        for (int i = 0; i < BENCH_SPAN; i++) a[i] = b[i] = (uint8_t)rand();
+
+        size_t n = (size_t)(rand() % BENCH_SPAN);
+        enum FbkOp op = (enum FbkOp)(rand() % 3);
+        uint8_t mask = (uint8_t)rand();
+        for (int changes = rand() % 4; changes > 0; changes--) {
+            b[rand() % BENCH_SPAN] ^= (uint8_t)(1 + rand() % 255);
+        }
+
+        size_t first = 0, last = 0;
+        fbkUse("scalar");
+        bool differ = fbkDiff(a, b, n, &first, &last);
+        memcpy(expected, a, BENCH_SPAN);
+        fbkSpan(expected, n, mask, op);
+
+        for (size_t k = 1; k < sizeof(kernel_names) / sizeof(kernel_names[0]); k++) {
+            if (!fbkUse(kernel_names[k])) continue;
+
+            size_t k_first = 0, k_last = 0;
+            bool k_differ = fbkDiff(a, b, n, &k_first, &k_last);
+            if (k_differ != differ || (differ && (k_first != first || k_last != last))) {
+                printf("%s fbkDiff() differs from scalar for a span of %zu bytes\n", kernel_names[k], n);
+                return false;
+            }
+
+            memcpy(result, a, BENCH_SPAN);
+            fbkSpan(result, n, mask, op);
+            if (memcmp(result, expected, BENCH_SPAN) != 0) {
+                printf("%s fbkSpan() differs from scalar for a span of %zu bytes\n", kernel_names[k], n);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * time the framebuffer operations with the kernels in use
+ */
+void time_kernels() {
+    FrameBuffer fb;
+    FbPresenter presenter;
+    FbRegion regions[FB_PAGES];
+
+    fbInit(&fb);
+    memset(&presenter, 0, sizeof(presenter));
+
+    long long start = bench_now();
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        fbInvertArea(&fb, 1, 0, 126, 64);
+    }
+    long long invert_ns = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        fb.pages[i % FB_PAGES][i % FB_WIDTH] ^= 1; // one byte changed per frame
+        fbPresent(&presenter, &fb, regions);
+    }
+    long long present_ns = bench_now() - start;
+
+    fbColour(&fb, "WHITE", "BLACK");
+    start = bench_now();
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        fbClearArea(&fb, 0, 8, 128, 16);
+    }
+    long long clear_ns = bench_now() - start;
+
+    printf("%-8s %14.1f %26.1f %14.1f\n", fbkName(), (double)invert_ns / BENCH_CALLS,
+           (double)present_ns / BENCH_CALLS, (double)clear_ns / BENCH_CALLS);
+}
+
+int main() {
+    printf("kernels chosen at startup: %s\n", fbkName());
+
+    if (!check_kernels()) return 1;
+    printf("%d random spans agree with the scalar kernels\n\n", BENCH_CHECKS);
+
+    printf("ns per call\n");
+    printf("%-8s %14s %26s %14s\n", "kernels", "invert 126x64", "present (1 byte changed)", "clear 128x16");
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); k++) {
+        if (fbkUse(kernel_names[k])) {
+            time_kernels();
+        } else {
+            printf("%-8s not supported here\n", kernel_names[k]);
+        }
+    }
+    return 0;
+}
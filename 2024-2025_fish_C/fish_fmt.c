@@ -0,0 +1,277 @@
+/**
+ * printf free formatting
+ * see fish_fmt.h
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "fish_fmt.h"
+
+#define FMT_TENS(t) #t "0" #t "1" #t "2" #t "3" #t "4" #t "5" #t "6" #t "7" #t "8" #t "9"
+
+const char fmt_digit_pairs[] = FMT_TENS(0) FMT_TENS(1) FMT_TENS(2) FMT_TENS(3) FMT_TENS(4)
+                               FMT_TENS(5) FMT_TENS(6) FMT_TENS(7) FMT_TENS(8) FMT_TENS(9);
+
+_Static_assert(sizeof(fmt_digit_pairs) == 201, "a pair of digits for each of 00 to 99");
+
+/**
+ * write the digits of a number backwards from the end of a buffer
+ * @param end - just past where the last digit goes
+ * @param value
+ * @return the first digit
+ */
+char *fmt_digits(char *end, unsigned long value) {
+    while (value >= 100) {
+        const char *pair = &fmt_digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        *--end = fmt_digit_pairs[value * 2 + 1];
+        *--end = fmt_digit_pairs[value * 2];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+/**
+ * append text to a buffer, truncating it to fit
+ * @param out
+ * @param size - of the buffer, including the terminator
+ * @param length - of the text already in the buffer
+ * @param text
+ * @param n - number of characters of text
+ * @return the new length
+ */
+size_t fmt_append(char *out, size_t size, size_t length, const char *text, size_t n) {
+    if (size == 0) return 0;
+
+    if (length + n > size - 1) n = size - 1 - length;
+    memcpy(out + length, text, n);
+    length += n;
+    out[length] = '\0';
+    return length;
+}
+
+/**
+ * append characters repeated
+ * @param out
+ * @param size
+ * @param length
+ * @param c
+ * @param n
+ * @return the new length
+ */
+size_t fmt_repeat(char *out, size_t size, size_t length, char c, size_t n) {
+    if (size == 0) return 0;
+
+    if (length + n > size - 1) n = size - 1 - length;
+    memset(out + length, c, n);
+    length += n;
+    out[length] = '\0';
+    return length;
+}
+
+/**
+ * append a field padded to a width
+ * @param out
+ * @param size
+ * @param length
+ * @param text
+ * @param n - number of characters of text
+ * @param width - minimum width of the field
+ * @param pad - ' ' or '0'. zeros go after any sign
+ * @param left - align to the left (padded with spaces)
+ * @return the new length
+ */
+size_t fmt_field(char *out, size_t size, size_t length, const char *text, size_t n, int width, char pad, bool left) {
+    size_t fill = width > 0 && (size_t)width > n ? (size_t)width - n : 0;
+
+    if (left) {
+        length = fmt_append(out, size, length, text, n);
+        return fmt_repeat(out, size, length, ' ', fill);
+    }
+    if (pad == '0' && n > 0 && *text == '-') {
+        length = fmt_append(out, size, length, text++, 1);
+        n--;
+    }
+    length = fmt_repeat(out, size, length, pad, fill);
+    return fmt_append(out, size, length, text, n);
+}
+
+/**
+ * convert a number to decimal
+ * @param buffer - at least FMT_LONG_SIZE characters
+ * @param value
+ * @return the first character, the text ends at buffer + FMT_LONG_SIZE - 1
+ */
+char *fmt_decimal(char *buffer, long value) {
+    char *end = buffer + FMT_LONG_SIZE - 1;
+    *end = '\0';
+
+    // negate as unsigned so that LONG_MIN works
+    char *start = fmt_digits(end, value < 0 ? 0UL - (unsigned long)value : (unsigned long)value);
+    if (value < 0) *--start = '-';
+    return start;
+}
+
+/**
+ * write two digits without a terminator, e.g. the minutes of a time
+ * @param out
+ * @param value - 0 to 99
+ * @return the character after the digits
+ */
+char *fmtTwoDigits(char *out, int value) {
+    const char *pair = &fmt_digit_pairs[((unsigned int)value % 100) * 2];
+    out[0] = pair[0];
+    out[1] = pair[1];
+    return out + 2;
+}
+
+/**
+ * @param out
+ * @param size - of out, FMT_INT_SIZE is enough for any value
+ * @param value
+ * @return the length written
+ */
+size_t fmtInt(char *out, size_t size, int value) {
+    return fmtLong(out, size, value);
+}
+
+/**
+ * @param out
+ * @param size - of out, FMT_LONG_SIZE is enough for any value
+ * @param value
+ * @return the length written
+ */
+size_t fmtLong(char *out, size_t size, long value) {
+    char buffer[FMT_LONG_SIZE];
+    char *text = fmt_decimal(buffer, value);
+    return fmt_append(out, size, 0, text, (size_t)(buffer + FMT_LONG_SIZE - 1 - text));
+}
+
+/**
+ * a number right aligned in a fixed width, e.g. "07" or "  7"
+ * @param out
+ * @param size
+ * @param value
+ * @param width - minimum number of characters, longer numbers aren't truncated
+ * @param pad - ' ' or '0'
+ * @return the length written
+ */
+size_t fmtIntWidth(char *out, size_t size, int value, int width, char pad) {
+    char buffer[FMT_LONG_SIZE];
+    char *text = fmt_decimal(buffer, value);
+    return fmt_field(out, size, 0, text, (size_t)(buffer + FMT_LONG_SIZE - 1 - text), width, pad, false);
+}
+
+/**
+ * a time of day with two digits for each part
+ * @param out
+ * @param size - FMT_TIME_SIZE for the whole time
+ * @param hour
+ * @param minute
+ * @param second
+ * @param separator - between the parts, e.g. ':'
+ * @return the length written
+ */
+size_t fmtTime(char *out, size_t size, int hour, int minute, int second, char separator) {
+    char buffer[FMT_TIME_SIZE];
+    char *end = fmtTwoDigits(buffer, hour);
+    *end++ = separator;
+    end = fmtTwoDigits(end, minute);
+    *end++ = separator;
+    end = fmtTwoDigits(end, second);
+    return fmt_append(out, size, 0, buffer, (size_t)(end - buffer));
+}
+
+/**
+ * an hour and minute the way the feed schedule shows them, e.g. "9:05"
+ * @param out
+ * @param size
+ * @param hour
+ * @param minute
+ * @return the length written
+ */
+size_t fmtHourMinute(char *out, size_t size, int hour, int minute) {
+    size_t length = fmtInt(out, size, hour);
+    length = fmt_append(out, size, length, ":", 1);
+
+    char buffer[FMT_LONG_SIZE];
+    char *text = fmt_decimal(buffer, minute);
+    return fmt_field(out, size, length, text, (size_t)(buffer + FMT_LONG_SIZE - 1 - text), 2, '0', false);
+}
+
+/**
+ * format text like snprintf but with only the conversions the display code uses:
+ * %d, %ld, %s, %c and %%, each with an optional '-' (left align) or '0' flag and a width
+ * @param out
+ * @param size - of out, the text is truncated to fit
+ * @param format
+ * @param ... - the values for the conversions
+ * @return the length written (not the length the whole text would have been)
+ */
+size_t fmtText(char *out, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    size_t length = fmt_append(out, size, 0, "", 0);
+    while (*format != '\0') {
+        const char *percent = strchr(format, '%');
+        if (percent == NULL) {
+            length = fmt_append(out, size, length, format, strlen(format));
+            break;
+        }
+        length = fmt_append(out, size, length, format, (size_t)(percent - format));
+        format = percent + 1;
+
+        bool left = false;
+        char pad = ' ';
+        for (; *format == '-' || *format == '0'; format++) {
+            if (*format == '-') left = true; else pad = '0';
+        }
+        int width = 0;
+        for (; *format >= '0' && *format <= '9'; format++) {
+            width = width * 10 + (*format - '0');
+        }
+        bool is_long = *format == 'l';
+        if (is_long) format++;
+
+        char buffer[FMT_LONG_SIZE];
+        switch (*format) {
+            case 'd': {
+                char *text = fmt_decimal(buffer, is_long ? va_arg(args, long) : va_arg(args, int));
+                length = fmt_field(out, size, length, text, (size_t)(buffer + FMT_LONG_SIZE - 1 - text), width, pad, left);
+                break;
+            }
+            case 's': {
+                const char *text = va_arg(args, const char *);
+                if (text == NULL) text = "(null)";
+                length = fmt_field(out, size, length, text, strlen(text), width, ' ', left);
+                break;
+            }
+            case 'c':
+                buffer[0] = (char)va_arg(args, int);
+                length = fmt_field(out, size, length, buffer, 1, width, ' ', left);
+                break;
+            case '%':
+                length = fmt_append(out, size, length, "%", 1);
+                break;
+            case '\0':
+                format--; // a % at the end, stop at the terminator
+                break;
+            default:
+                // not supported, copied as it is
+                length = fmt_append(out, size, length, percent, (size_t)(format + 1 - percent));
+                break;
+        }
+        format++;
+    }
+
+    va_end(args);
+    return length;
+}
@@ -0,0 +1,38 @@
+/*
+ * Number and text formatting for code that runs every frame (menus, display commands, widgets).
+ *
+ * These write into a caller's buffer without going through stdio: integers are converted two digits at a
+ * time from a table of "00".."99", and fmtText() understands just the conversions the display code uses.
+ * Every function always terminates the buffer (if size > 0), truncating what doesn't fit, and returns
+ * the length written.
+ *
+ * fmtText() is declared with the printf format attribute, so gcc and clang check its format string
+ * against the arguments at compile time in the same way as printf.
+ */
+#ifndef FISH_FMT_H
+#define FISH_FMT_H
+
+#include <stddef.h>
+
+#define FMT_INT_SIZE 12 // buffer for any int, e.g. "-2147483648"
+#define FMT_LONG_SIZE 21 // buffer for any long
+#define FMT_TIME_SIZE 9 // buffer for "hh-mm-ss"
+
+#if defined(__GNUC__)
+#define FMT_CHECK(format_index, first_arg) __attribute__((format(printf, format_index, first_arg)))
+#else
+#define FMT_CHECK(format_index, first_arg)
+#endif
+
+extern const char fmt_digit_pairs[]; // "000102...9899"
+
+char *fmtTwoDigits(char *out, int value); // write 2 digits for 0..99 (no terminator), returns the end
+size_t fmtInt(char *out, size_t size, int value);
+size_t fmtLong(char *out, size_t size, long value);
+size_t fmtIntWidth(char *out, size_t size, int value, int width, char pad); // right aligned, e.g. pad '0'
+size_t fmtTime(char *out, size_t size, int hour, int minute, int second, char separator); // "hh-mm-ss"
+size_t fmtHourMinute(char *out, size_t size, int hour, int minute); // "h:mm"
+// %d %ld %s %c %% with an optional '-' or '0' flag and width, e.g. "%02d"
+size_t fmtText(char *out, size_t size, const char *format, ...) FMT_CHECK(3, 4);
+
+#endif // FISH_FMT_H
@@ -0,0 +1,151 @@
+/**
+ * Debug overlay
+ * see fish_hud.h
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fish.h"
+#include "fish_hud.h"
+#include "fish_fmt.h"
+#include "fish_stats.h"
+
+#define HUD_CHARS 8 // characters per overlay line
+#define HUD_CHAR_WIDTH 6
+#define HUD_CHAR_HEIGHT 8
+#define HUD_X (128 - HUD_CHARS * HUD_CHAR_WIDTH) // top right corner of the 128x64 display
+#define HUD_Y 0
+
+/**
+ * @param hud
+ * @param where - HUD_OFF or HUD_DISPLAY and/or HUD_INFO
+ */
+void hudInit(Hud *hud, int where) {
+    memset(hud, 0, sizeof(*hud));
+    hud->where = where;
+    hud->window_start_ns = statsNow();
+    jniCounts(&hud->window_counts);
+}
+
+/**
+ * turn the overlay on or off, or change where it is shown
+ * @param hud
+ * @param where - HUD_OFF or HUD_DISPLAY and/or HUD_INFO
+ */
+void hudEnable(Hud *hud, int where) {
+    if ((hud->where & HUD_DISPLAY) && !(where & HUD_DISPLAY)) {
+        hud->erase = true;
+    }
+    if (hud->where == HUD_OFF && where != HUD_OFF) {
+        // the numbers aren't followed while it is off, start a new period
+        hud->window_start_ns = statsNow();
+        jniCounts(&hud->window_counts);
+        memset(&hud->own, 0, sizeof(hud->own));
+        hud->lines[0][0] = '\0';
+    }
+    hud->where = where;
+}
+
+/**
+ * @param name - e.g. the value of the HUD_ENV environment variable
+ * @return where the overlay is to be shown
+ */
+int hudWhere(const char *name) {
+    if (name == NULL) return HUD_OFF;
+    if (strcmp(name, "display") == 0) return HUD_DISPLAY;
+    if (strcmp(name, "info") == 0) return HUD_INFO;
+    if (strcmp(name, "both") == 0) return HUD_DISPLAY | HUD_INFO;
+    return HUD_OFF;
+}
+
+/**
+ * start timing a pass of the loop
+ * @param hud
+ */
+void hudLoopStart(Hud *hud) {
+    hud->loop_start_ns = statsNow();
+}
+
+/**
+ * @param value
+ * @param limit
+ * @return value limited to 0 .. limit so that it fits its place in the overlay
+ */
+long hud_limit(double value, long limit) {
+    if (value < 0) return 0;
+    return value > limit ? limit : (long)(value + 0.5);
+}
+
+/**
+ * work out the numbers for the period that has just finished and start the next one
+ * @param hud
+ * @param now_ns
+ */
+void hud_update(Hud *hud, long long now_ns) {
+    JniCounts counts;
+    jniCounts(&counts);
+
+    // the overlay's own drawing and messages aren't part of what is being measured
+    double seconds = (now_ns - hud->window_start_ns) / 1e9;
+    double frames = (double)(counts.frames - hud->window_counts.frames - hud->own.frames);
+    double commands = (double)(counts.display_commands - hud->window_counts.display_commands - hud->own.display_commands);
+    double calls = (double)(counts.jni_calls - hud->window_counts.jni_calls - hud->own.jni_calls);
+    double per_frame = frames > 0 ? 1 / frames : 0;
+    double loop_ms = hud->loop_ns / 1e6;
+
+    fmtText(hud->lines[0], HUD_TEXT_SIZE, "F%-2ld C%-3ld", hud_limit(frames / seconds, 99), hud_limit(commands * per_frame, 999));
+    fmtText(hud->lines[1], HUD_TEXT_SIZE, "J%-2ld L%-3ld", hud_limit(calls * per_frame, 99), hud_limit(loop_ms, 999));
+
+    if (hud->where & HUD_INFO) {
+        // tenths without floating point formatting
+        long commands_tenths = hud_limit(commands * per_frame * 10, 99999);
+        long calls_tenths = hud_limit(calls * per_frame * 10, 99999);
+
+        char message[HUD_TEXT_SIZE];
+        fmtText(message, HUD_TEXT_SIZE, "hud: %ld fps, %ld.%ld commands/frame, %ld.%ld jni calls/frame, loop %ld us",
+                hud_limit(frames / seconds, 9999), commands_tenths / 10, commands_tenths % 10,
+                calls_tenths / 10, calls_tenths % 10, hud_limit(hud->loop_ns / 1e3, 9999999));
+
+        // the next period starts after the message so it isn't counted (unless it is sent asynchronously)
+        infoMessage(message);
+        jniCounts(&counts);
+    }
+
+    hud->window_start_ns = now_ns;
+    hud->window_counts = counts;
+    memset(&hud->own, 0, sizeof(hud->own));
+}
+
+/**
+ * measure the pass of the loop, update the numbers once per HUD_UPDATE_MS and draw the overlay
+ * @param hud
+ */
+void hudDraw(Hud *hud) {
+    long long now = statsNow();
+    hud->loop_ns = now - hud->loop_start_ns;
+
+    if (hud->where == HUD_OFF && !hud->erase) return;
+
+    if (now - hud->window_start_ns >= HUD_UPDATE_MS * 1000000LL) {
+        hud_update(hud, now);
+    }
+
+    if (!(hud->where & HUD_DISPLAY) && !hud->erase) return;
+
+    JniCounts before, after;
+    jniCounts(&before);
+
+    displayColour("white", "black");
+    if (hud->erase) {
+        displayClearArea(HUD_X, HUD_Y, HUD_CHARS * HUD_CHAR_WIDTH, 2 * HUD_CHAR_HEIGHT);
+        hud->erase = false;
+    } else if (hud->lines[0][0] != '\0') {
+        displayText(HUD_X, HUD_Y, hud->lines[0], 1);
+        displayText(HUD_X, HUD_Y + HUD_CHAR_HEIGHT, hud->lines[1], 1);
+    }
+
+    jniCounts(&after);
+    hud->own.display_commands += after.display_commands - before.display_commands;
+    hud->own.jni_calls += after.jni_calls - before.jni_calls;
+}
@@ -0,0 +1,51 @@
+/*
+ * Debug overlay (heads up display) for a main loop: frames per second, display commands and JNI round trips
+ * per frame and the time the last pass of the loop took.
+ *
+ * The numbers are averaged over about a second (HUD_UPDATE_MS) from jniCounts(). They can be drawn in the top
+ * right corner of the display, two lines of 8 characters:
+ *   F<fps> C<display commands per frame>
+ *   J<jni calls per frame> L<loop time in ms>
+ * and/or sent to the emulator info area with infoMessage() once per update.
+ *
+ * The overlay is drawn in every frame so it stays on top of whatever the loop drew, but its text only changes
+ * once per update so the repeated text isn't sent again (see the display shadow in fish.c). The commands and
+ * calls the overlay makes itself are left out of the numbers it shows.
+ */
+#ifndef FISH_HUD_H
+#define FISH_HUD_H
+
+#include <stdbool.h>
+
+#include "fish.h"
+
+#define HUD_ENV "FISH_HUD" // "display", "info" or "both" turns the overlay on at startup (see hudWhere())
+#define HUD_UPDATE_MS 1000
+#define HUD_TEXT_SIZE 96
+
+// where the overlay is shown, combined with |
+#define HUD_OFF 0
+#define HUD_DISPLAY 1
+#define HUD_INFO 2
+
+typedef struct hud {
+    int where;
+    bool erase; // the overlay was turned off, clear it from the display at the next draw
+
+    long long loop_start_ns; // statsNow() at the start of the pass being timed
+    long long loop_ns; // time taken by the last pass
+
+    long long window_start_ns; // start of the period being averaged
+    JniCounts window_counts; // totals at the start of the period
+    JniCounts own; // commands and calls made by the overlay itself in this period
+
+    char lines[2][HUD_TEXT_SIZE]; // overlay text, changed once per update
+} Hud;
+
+void hudInit(Hud *hud, int where);
+void hudEnable(Hud *hud, int where); // HUD_OFF to turn the overlay off
+int hudWhere(const char *name); // "display", "info" or "both", HUD_OFF for anything else (or NULL)
+void hudLoopStart(Hud *hud); // call at the start of each pass of the loop
+void hudDraw(Hud *hud); // call at the end of the pass, inside its display frame. measures the pass first
+
+#endif // FISH_HUD_H
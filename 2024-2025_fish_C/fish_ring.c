@@ -0,0 +1,127 @@
+/**
+ * Single producer / single consumer command ring shared with the JavaFX emulator
+ * see fish_ring.h for the memory layout
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "fish_ring.h"
+
+// delay while waiting for the consumer to make space in a full ring
+#define RING_FULL_WAIT_MS 1L
+
+_Static_assert(sizeof(RingRecord) == RING_RECORD_SIZE, "ring record layout is shared with java");
+_Static_assert(offsetof(CommandRing, head) == 64, "ring header layout is shared with java");
+_Static_assert(offsetof(CommandRing, tail) == 128, "ring header layout is shared with java");
+_Static_assert(offsetof(CommandRing, records) == 192, "ring header layout is shared with java");
+
+/**
+ * allocate and initialise an empty command ring
+ * @param capacity - number of records, rounded up to a power of 2
+ * @return the ring or NULL if the memory could not be allocated
+ */
+CommandRing *ringCreate(int capacity) {
+    int size = 1;
+    while (size < capacity) size <<= 1;
+
+    CommandRing *ring = calloc(1, sizeof(CommandRing) + (size_t)size * sizeof(RingRecord));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->magic = RING_MAGIC;
+    ring->version = RING_VERSION;
+    ring->capacity = size;
+    ring->record_size = RING_RECORD_SIZE;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    return ring;
+}
+
+/**
+ * free the ring memory. java must no longer be using it
+ * @param ring
+ */
+void ringDestroy(CommandRing *ring) {
+    free(ring);
+}
+
+/**
+ * @param ring
+ * @return the size of the shared memory in bytes
+ */
+size_t ringSize(CommandRing *ring) {
+    return sizeof(CommandRing) + (size_t)ring->capacity * sizeof(RingRecord);
+}
+
+/**
+ * sleep while the ring is full. msleep() can't be used here, it may present a held back frame and the producer
+ * may be holding the ring lock
+ * @param msec
+ */
+static void ring_wait(long msec) {
+    struct timespec ts = { msec / 1000, (msec % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * write a command record and publish it to the consumer
+ * @param ring
+ * @param opcode - one of the RingOpcode values
+ * @param args - integer arguments (may be NULL if nargs is 0)
+ * @param nargs - number of arguments, at most RING_MAX_ARGS
+ * @param text - one or more null terminated strings, truncated to fit the record. may be NULL
+ * @param length - number of bytes of text including the null terminators
+ */
+void ringPush(CommandRing *ring, int opcode, const int *args, int nargs, const char *text, size_t length) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // wait for space. the consumer frees records by moving the tail on
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= (uint32_t)ring->capacity) {
+        ring_wait(RING_FULL_WAIT_MS);
+    }
+
+    RingRecord *record = &ring->records[head & (uint32_t)(ring->capacity - 1)];
+    record->opcode = opcode;
+    for (int i = 0; i < RING_MAX_ARGS; i++) {
+        record->args[i] = (i < nargs) ? args[i] : 0;
+    }
+
+    if (text == NULL) length = 0;
+    if (length > RING_TEXT_SIZE - 1) length = RING_TEXT_SIZE - 1;
+    memcpy(record->text, text, length);
+    record->text[length] = '\0';
+
+    // the record must be complete before the consumer can see the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * read the oldest command record
+ * @param ring
+ * @param record - receives a copy of the record
+ * @return false if the ring is empty
+ */
+bool ringPop(CommandRing *ring, RingRecord *record) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        return false;
+    }
+
+    *record = ring->records[tail & (uint32_t)(ring->capacity - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @param ring
+ * @return true if the consumer has read every record
+ */
+bool ringEmpty(CommandRing *ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+           atomic_load_explicit(&ring->head, memory_order_acquire);
+}
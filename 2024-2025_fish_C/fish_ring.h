@@ -0,0 +1,81 @@
+/*
+ * Binary command ring shared between the C code and the JavaFX fish feeder emulator.
+ *
+ * A single producer (the C processing thread) writes fixed size command records
+ * and a single consumer (a JavaFX side thread) drains them. The memory is handed
+ * to java once with NewDirectByteBuffer() so adding a command costs a memory write
+ * rather than a JNI call and string formatting.
+ *
+ * Memory layout (native byte order, java must use ByteBuffer.order(ByteOrder.nativeOrder())):
+ *   offset   0  int32 magic (RING_MAGIC)
+ *   offset   4  int32 version (RING_VERSION)
+ *   offset   8  int32 capacity - number of records, a power of 2
+ *   offset  12  int32 record size in bytes (RING_RECORD_SIZE)
+ *   offset  64  uint32 head - count of records written, only changed by the producer
+ *   offset 128  uint32 tail - count of records read, only changed by the consumer
+ *   offset 192  records. record n is stored at index n & (capacity - 1)
+ * Each record is an int32 opcode, 6 int32 arguments and a null terminated text field.
+ * The producer publishes a record by incrementing head after the record is written,
+ * the consumer releases it by incrementing tail after it has been read.
+ */
+#ifndef FISH_RING_H
+#define FISH_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define RING_MAGIC 0x46495348 // "FISH"
+#define RING_VERSION 2 // 2 added fill rect, invert area and bitmap
+#define RING_MAX_ARGS 6
+#define RING_TEXT_SIZE 100
+#define RING_RECORD_SIZE 128
+
+// command record opcodes. the arguments match the equivalent string commands
+enum RingOpcode {
+    RING_CLEAR_DISPLAY = 1,
+    RING_CLEAR_AREA = 2, // x y w h
+    RING_LINE = 3, // x0 y0 x1 y1
+    RING_PIXEL = 4, // x y
+    RING_TEXTXY = 5, // x y size, text
+    RING_COLOUR = 6, // text holds the foreground then background colour as two null terminated strings
+    RING_MOTOR_STEP = 7,
+    RING_FOOD = 8, // food level
+    RING_MESSAGE = 9, // text
+    RING_END_FRAME = 10, // a complete display frame has been written
+    RING_FILL_RECT = 11, // x y w h
+    RING_INVERT_AREA = 12, // x y w h
+    RING_BITMAP = 13 // x y w h, text holds the bitmap rows as hex digits
+};
+
+typedef struct ringRecord {
+    int32_t opcode;
+    int32_t args[RING_MAX_ARGS];
+    char text[RING_TEXT_SIZE];
+} RingRecord;
+
+typedef struct commandRing {
+    int32_t magic;
+    int32_t version;
+    int32_t capacity;
+    int32_t record_size;
+    char pad0[48];
+    _Atomic uint32_t head; // own cache line so producer and consumer don't share
+    char pad1[60];
+    _Atomic uint32_t tail;
+    char pad2[60];
+    RingRecord records[];
+} CommandRing;
+
+CommandRing *ringCreate(int capacity); // capacity is rounded up to a power of 2. NULL if out of memory
+void ringDestroy(CommandRing *ring);
+size_t ringSize(CommandRing *ring); // size in bytes of the shared memory
+
+// add a command, waiting for the consumer if the ring is full.
+// text is length bytes of one or more null terminated strings (NULL if none)
+void ringPush(CommandRing *ring, int opcode, const int *args, int nargs, const char *text, size_t length);
+bool ringPop(CommandRing *ring, RingRecord *record); // consumer side. false if the ring is empty
+bool ringEmpty(CommandRing *ring);
+
+#endif // FISH_RING_H
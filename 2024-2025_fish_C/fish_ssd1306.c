@@ -0,0 +1,344 @@
+/**
+ * SSD1306 controller and I2C bus model
+ * see fish_ssd1306.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fish_fb.h"
+#include "fish_fbk.h"
+#include "fish_ssd1306.h"
+
+#define SSD_START_STOP_CLOCKS 2
+#define SSD_WINDOW_COMMAND_BYTES 6 // column address and page address commands with their parameters
+
+// initialisation sequence, as sent by the Arduino display libraries
+const uint8_t SSD_INIT_SEQUENCE[] = {
+        SSD_DISPLAY_OFF,
+        0xD5, 0x80, // clock divide ratio
+        0xA8, 0x3F, // multiplex ratio, 64 rows
+        0xD3, 0x00, // no display offset
+        0x40, // start line 0
+        0x8D, 0x14, // charge pump on
+        SSD_SET_ADDRESSING_MODE, SsdHorizontal,
+        0xA1, // column 127 is segment 0
+        0xC8, // scan rows from the bottom
+        0xDA, 0x12, // com pins
+        SSD_SET_CONTRAST, SSD_CONTRAST,
+        0xD9, 0xF1, // precharge period
+        0xDB, 0x40, // vcomh level
+        0xA4, // show the RAM contents
+        SSD_DISPLAY_NORMAL,
+        SSD_DISPLAY_ON
+};
+
+/**
+ * @param command - first byte of a command
+ * @return the number of parameter bytes that follow the command
+ */
+int ssd_parameters(uint8_t command) {
+    switch (command) {
+        case SSD_SET_ADDRESSING_MODE: case SSD_SET_CONTRAST:
+        case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+            return 1;
+        case SSD_SET_COLUMN_ADDRESS: case SSD_SET_PAGE_ADDRESS: case 0xA3:
+            return 2;
+        case 0x29: case 0x2A: // vertical and horizontal scroll setup
+            return 5;
+        case 0x26: case 0x27: // horizontal scroll setup
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * carry out a complete command
+ * @param ssd
+ * @param command - the command byte then its parameters
+ */
+void ssd_execute(Ssd1306 *ssd, const uint8_t *command) {
+    uint8_t c = command[0];
+
+    if (c == SSD_SET_ADDRESSING_MODE) {
+        if ((command[1] & 3) != 3) ssd->addressing = (enum SsdAddressing)(command[1] & 3);
+    } else if (c == SSD_SET_COLUMN_ADDRESS) {
+        ssd->column_start = command[1] & 0x7F;
+        ssd->column_end = command[2] & 0x7F;
+        ssd->column = ssd->column_start;
+    } else if (c == SSD_SET_PAGE_ADDRESS) {
+        ssd->page_start = command[1] & 7;
+        ssd->page_end = command[2] & 7;
+        ssd->page = ssd->page_start;
+    } else if (c == SSD_SET_CONTRAST) {
+        ssd->contrast = command[1];
+    } else if (c == SSD_DISPLAY_NORMAL || c == SSD_DISPLAY_INVERSE) {
+        ssd->inverse = c == SSD_DISPLAY_INVERSE;
+    } else if (c == SSD_DISPLAY_OFF || c == SSD_DISPLAY_ON) {
+        ssd->display_on = c == SSD_DISPLAY_ON;
+    } else if (c >= 0xB0 && c <= 0xB7) {
+        ssd->page = c & 7; // page addressing mode
+    } else if (c <= 0x0F) {
+        ssd->column = (ssd->column & 0x70) | c;
+    } else if (c >= 0x10 && c <= 0x17) {
+        ssd->column = (ssd->column & 0x0F) | ((c & 7) << 4);
+    }
+}
+
+/**
+ * receive a command byte, running the command once all of its parameters have arrived
+ * @param ssd
+ * @param byte
+ */
+void ssd_command_byte(Ssd1306 *ssd, uint8_t byte) {
+    ssd->command[ssd->command_length++] = byte;
+
+    if (ssd->command_length > ssd_parameters(ssd->command[0])) {
+        ssd_execute(ssd, ssd->command);
+        ssd->command_length = 0;
+    }
+}
+
+/**
+ * write a data byte to the display RAM and move to the next address
+ * @param ssd
+ * @param byte
+ */
+void ssd_data_byte(Ssd1306 *ssd, uint8_t byte) {
+    ssd->gddram[ssd->page][ssd->column] = byte;
+
+    switch (ssd->addressing) {
+        case SsdHorizontal:
+            if (++ssd->column > ssd->column_end) {
+                ssd->column = ssd->column_start;
+                if (++ssd->page > ssd->page_end) ssd->page = ssd->page_start;
+            }
+            break;
+        case SsdVertical:
+            if (++ssd->page > ssd->page_end) {
+                ssd->page = ssd->page_start;
+                if (++ssd->column > ssd->column_end) ssd->column = ssd->column_start;
+            }
+            break;
+        case SsdPage:
+            if (++ssd->column >= FB_WIDTH) ssd->column = 0;
+            break;
+    }
+}
+
+/**
+ * reset the controller and send the initialisation sequence. the display RAM is cleared
+ * (the display libraries clear it after initialising, that isn't counted)
+ * @param ssd
+ * @param bus_hz - I2C clock, e.g. SSD_BUS_HZ
+ */
+void ssdInit(Ssd1306 *ssd, long bus_hz) {
+    memset(ssd, 0, sizeof(*ssd));
+
+    // power on reset state
+    ssd->addressing = SsdPage;
+    ssd->column_end = FB_WIDTH - 1;
+    ssd->page_end = FB_PAGES - 1;
+    ssd->contrast = 0x7F;
+    ssd->bus_hz = bus_hz > 0 ? bus_hz : SSD_BUS_HZ;
+
+    ssdCommands(ssd, SSD_INIT_SEQUENCE, sizeof(SSD_INIT_SEQUENCE));
+}
+
+/**
+ * put one I2C write transaction on the bus and pass it to the controller
+ * @param ssd
+ * @param control - control byte. bit 7 (Co) set means one payload byte then another control byte
+ * @param payload
+ * @param n - payload bytes
+ */
+void ssdTransaction(Ssd1306 *ssd, uint8_t control, const uint8_t *payload, size_t n) {
+    ssd->transactions++;
+    ssd->bytes += 2 + n;
+    ssd->clocks += 9 * (2 + n) + SSD_START_STOP_CLOCKS;
+
+    if (ssd->trace != NULL) {
+        fprintf(ssd->trace, "%02X %02X", SSD_I2C_ADDRESS << 1, control);
+        for (size_t i = 0; i < n; i++) fprintf(ssd->trace, " %02X", payload[i]);
+        fprintf(ssd->trace, "\n");
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        bool single = (control & 0x80) != 0;
+        size_t end = single ? i + 1 : n;
+
+        for (; i < end; i++) {
+            if (control & 0x40) {
+                ssd_data_byte(ssd, payload[i]);
+            } else {
+                ssd_command_byte(ssd, payload[i]);
+            }
+        }
+        if (single && i < n) control = payload[i++];
+    }
+}
+
+/**
+ * send commands in a single transaction
+ * @param ssd
+ * @param commands - command bytes and their parameters
+ * @param n
+ */
+void ssdCommands(Ssd1306 *ssd, const uint8_t *commands, size_t n) {
+    ssdTransaction(ssd, SSD_CONTROL_COMMAND, commands, n);
+}
+
+/**
+ * set the panel power and brightness in a single transaction. the display RAM keeps its contents while the
+ * panel is off
+ * @param ssd
+ * @param on
+ * @param contrast - e.g. SSD_CONTRAST or SSD_CONTRAST_DIMMED
+ */
+void ssdPower(Ssd1306 *ssd, bool on, uint8_t contrast) {
+    const uint8_t commands[] = {SSD_SET_CONTRAST, contrast, on ? SSD_DISPLAY_ON : SSD_DISPLAY_OFF};
+    ssdCommands(ssd, commands, sizeof(commands));
+}
+
+/**
+ * @param pages - pages in a window
+ * @param columns - columns in a window
+ * @return bus bytes needed to send a window
+ */
+size_t ssd_window_bytes(int pages, int columns) {
+    size_t data = (size_t)pages * (size_t)columns;
+    size_t chunks = (data + SSD_DATA_CHUNK - 1) / SSD_DATA_CHUNK;
+    return 2 + SSD_WINDOW_COMMAND_BYTES + data + 2 * chunks;
+}
+
+/**
+ * set the address window then send its pixels in data transactions
+ * @param ssd
+ * @param fb
+ * @param first_page
+ * @param last_page
+ * @param first_column
+ * @param last_column
+ */
+void ssd_send_window(Ssd1306 *ssd, const FrameBuffer *fb, int first_page, int last_page,
+                     int first_column, int last_column) {
+    if (ssd->addressing != SsdHorizontal) {
+        uint8_t mode[] = {SSD_SET_ADDRESSING_MODE, SsdHorizontal};
+        ssdCommands(ssd, mode, sizeof(mode));
+    }
+
+    uint8_t window[SSD_WINDOW_COMMAND_BYTES] = {
+            SSD_SET_COLUMN_ADDRESS, (uint8_t)first_column, (uint8_t)last_column,
+            SSD_SET_PAGE_ADDRESS, (uint8_t)first_page, (uint8_t)last_page
+    };
+    ssdCommands(ssd, window, sizeof(window));
+
+    // horizontal addressing: across the columns of each page in turn
+    uint8_t chunk[SSD_DATA_CHUNK];
+    size_t length = 0;
+    for (int page = first_page; page <= last_page; page++) {
+        for (int column = first_column; column <= last_column; column++) {
+            chunk[length++] = fb->pages[page][column];
+            if (length == SSD_DATA_CHUNK) {
+                ssdTransaction(ssd, SSD_CONTROL_DATA, chunk, length);
+                length = 0;
+            }
+        }
+    }
+    if (length > 0) {
+        ssdTransaction(ssd, SSD_CONTROL_DATA, chunk, length);
+    }
+}
+
+/**
+ * send the parts of a frame that differ from what the display is showing. the changed columns of each page
+ * are a window, windows of neighbouring pages are sent as one when that takes fewer bytes
+ * @param ssd
+ * @param fb
+ * @return bus time for the frame in nanoseconds, 0 if nothing needed sending
+ */
+long long ssdUpdate(Ssd1306 *ssd, const FrameBuffer *fb) {
+    unsigned long long bytes = ssd->bytes;
+    unsigned long long clocks = ssd->clocks;
+    int window_page = -1; // window being built, -1 if none
+    int window_first = 0;
+    int window_last = 0;
+    int page_count = 0;
+
+    for (int page = 0; page <= FB_PAGES; page++) {
+        size_t first, last;
+        bool changed = page < FB_PAGES && fbkDiff(fb->pages[page], ssd->gddram[page], FB_WIDTH, &first, &last);
+
+        if (changed && window_page >= 0 && window_page + page_count == page) {
+            int merged_first = (int)first < window_first ? (int)first : window_first;
+            int merged_last = (int)last > window_last ? (int)last : window_last;
+            size_t separate = ssd_window_bytes(page_count, window_last - window_first + 1) +
+                              ssd_window_bytes(1, (int)(last - first + 1));
+            if (ssd_window_bytes(page_count + 1, merged_last - merged_first + 1) <= separate) {
+                window_first = merged_first;
+                window_last = merged_last;
+                page_count++;
+                continue;
+            }
+        }
+
+        if (window_page >= 0) {
+            ssd_send_window(ssd, fb, window_page, window_page + page_count - 1, window_first, window_last);
+            window_page = -1;
+        }
+        if (changed) {
+            window_page = page;
+            window_first = (int)first;
+            window_last = (int)last;
+            page_count = 1;
+        }
+    }
+
+    size_t frame_bytes = (size_t)(ssd->bytes - bytes);
+    if (frame_bytes == 0) {
+        ssd->unchanged++;
+        return 0;
+    }
+
+    long long ns = ssdBusNs(ssd, ssd->clocks - clocks);
+    ssd->frames++;
+    ssd->frame_bytes += frame_bytes;
+    ssd->frame_ns += (unsigned long long)ns;
+    ssd->last_bytes = frame_bytes;
+    ssd->last_ns = ns;
+    if (frame_bytes > ssd->max_bytes) ssd->max_bytes = frame_bytes;
+    if (ns > ssd->max_ns) ssd->max_ns = ns;
+
+    return ns;
+}
+
+/**
+ * @param ssd
+ * @param clocks
+ * @return the time the clocks take on the bus in nanoseconds
+ */
+long long ssdBusNs(const Ssd1306 *ssd, unsigned long long clocks) {
+    long hz = ssd->bus_hz > 0 ? ssd->bus_hz : SSD_BUS_HZ; // not initialised
+    return (long long)(clocks * 1000000000ULL / (unsigned long long)hz);
+}
+
+/**
+ * write the frame statistics
+ * @param ssd
+ * @param out - e.g. stdout
+ */
+void ssdReport(const Ssd1306 *ssd, FILE *out) {
+    double mean_bytes = ssd->frames == 0 ? 0 : (double)ssd->frame_bytes / (double)ssd->frames;
+    double mean_ms = ssd->frames == 0 ? 0 : (double)ssd->frame_ns / (double)ssd->frames / 1e6;
+
+    fprintf(out, "ssd1306 %ld kHz i2c: %lu frames sent, %lu unchanged. bytes per frame mean %.0f max %zu, "
+                 "bus time per frame mean %.2f ms max %.2f ms",
+            ssd->bus_hz / 1000, ssd->frames, ssd->unchanged, mean_bytes, ssd->max_bytes, mean_ms, ssd->max_ns / 1e6);
+    if (mean_ms > 0) {
+        fprintf(out, " (at most %.0f frames per second)", 1000.0 / mean_ms);
+    }
+    fprintf(out, "\n");
+}
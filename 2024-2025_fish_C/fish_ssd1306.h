@@ -0,0 +1,85 @@
+/*
+ * Emulation of the SSD1306 OLED controller behind the 128x64 display (GOFi2cOLED on the real feeder).
+ *
+ * Each presented frame is turned into the I2C transactions the real hardware would receive: the changed
+ * columns of each page are set as a column/page address window followed by the pixel data. The
+ * transactions are run through a model of the controller's GDDRAM addressing, so its memory ends up as
+ * the display would show it, and the bytes and time taken on the bus are counted. This shows whether a
+ * refresh rate fits the 400 kHz bus.
+ *
+ * A write transaction is: start, address byte, control byte, payload, stop. Control byte 0x00 is followed
+ * by command bytes and 0x40 by data bytes. Each byte takes 9 clocks (8 bits and the acknowledge) and the
+ * start and stop conditions are counted as a clock each.
+ */
+#ifndef FISH_SSD1306_H
+#define FISH_SSD1306_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fish_fb.h"
+
+#define SSD_I2C_ADDRESS 0x3C
+#define SSD_BUS_HZ 400000L // fast mode I2C
+#define SSD_DATA_CHUNK 16 // data bytes per transaction, the Arduino Wire library buffer is 32 bytes
+#define SSD_CONTROL_COMMAND 0x00
+#define SSD_CONTROL_DATA 0x40
+
+// SSD1306 commands used here
+#define SSD_SET_ADDRESSING_MODE 0x20 // 1 parameter: 0 horizontal, 1 vertical, 2 page
+#define SSD_SET_COLUMN_ADDRESS 0x21 // 2 parameters: start, end
+#define SSD_SET_PAGE_ADDRESS 0x22 // 2 parameters: start, end
+#define SSD_SET_CONTRAST 0x81 // 1 parameter
+#define SSD_DISPLAY_NORMAL 0xA6
+#define SSD_DISPLAY_INVERSE 0xA7
+#define SSD_DISPLAY_OFF 0xAE
+#define SSD_DISPLAY_ON 0xAF
+
+#define SSD_CONTRAST 0xCF // contrast set by the initialisation sequence
+#define SSD_CONTRAST_DIMMED 0x08
+
+enum SsdAddressing {SsdHorizontal = 0, SsdVertical = 1, SsdPage = 2};
+
+typedef struct ssd1306 {
+    uint8_t gddram[FB_PAGES][FB_WIDTH]; // display RAM, in the same page layout as the framebuffer
+
+    // controller state
+    enum SsdAddressing addressing;
+    int column_start, column_end, page_start, page_end; // address window
+    int column, page; // where the next data byte goes
+    bool display_on;
+    bool inverse;
+    uint8_t contrast;
+    uint8_t command[8]; // command being received, its parameters may come in later transactions
+    int command_length;
+
+    // bus accounting
+    long bus_hz;
+    FILE *trace; // if set every transaction is written as a line of hex bytes
+    unsigned long transactions;
+    unsigned long long bytes; // every byte on the bus, including address and control bytes
+    unsigned long long clocks;
+
+    // frames
+    unsigned long frames; // frames that needed sending
+    unsigned long unchanged; // frames the display was already showing
+    unsigned long long frame_bytes; // bus bytes of all frames
+    unsigned long long frame_ns; // bus time of all frames
+    size_t last_bytes; // bus bytes of the last frame
+    long long last_ns;
+    size_t max_bytes;
+    long long max_ns;
+} Ssd1306;
+
+void ssdInit(Ssd1306 *ssd, long bus_hz); // reset and send the usual initialisation sequence, display on
+void ssdTransaction(Ssd1306 *ssd, uint8_t control, const uint8_t *payload, size_t n); // one write transaction
+void ssdCommands(Ssd1306 *ssd, const uint8_t *commands, size_t n); // a command transaction
+void ssdPower(Ssd1306 *ssd, bool on, uint8_t contrast); // turn the panel on or off (the RAM is kept) and set its contrast
+// send the windows of fb that differ from the display RAM. returns the bus time for the frame in ns, 0 if unchanged
+long long ssdUpdate(Ssd1306 *ssd, const FrameBuffer *fb);
+long long ssdBusNs(const Ssd1306 *ssd, unsigned long long clocks); // time the bus takes for a number of clocks
+void ssdReport(const Ssd1306 *ssd, FILE *out); // frames, bytes and bus time per frame, the largest frame rate
+
+#endif // FISH_SSD1306_H
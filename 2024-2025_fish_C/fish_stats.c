@@ -0,0 +1,233 @@
+/**
+ * Per opcode latency histograms for the emulator calls
+ * see fish_stats.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "fish.h"
+#include "fish_stats.h"
+
+// file the JSON statistics are written to when a signal is received (the text goes to the console)
+#define STATS_SIGNAL_FILE "jni_stats.json"
+
+OpcodeStats opcode_stats[STATS_MAX_OPCODES];
+_Atomic int opcode_stats_count = 0; // entries are published by incrementing this after the name is set
+pthread_mutex_t opcode_stats_mutex = PTHREAD_MUTEX_INITIALIZER; // only needed to add an opcode
+volatile sig_atomic_t stats_signalled = 0;
+
+/**
+ * @return monotonic clock in nanoseconds
+ */
+long long statsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * find the statistics for an opcode, adding it if it is new
+ * @param opcode
+ * @return the statistics entry. the last entry is shared by any opcodes once the table is full
+ */
+OpcodeStats *find_stats(const char *opcode) {
+    int count = atomic_load(&opcode_stats_count);
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(opcode_stats[i].name, opcode) == 0) {
+            return &opcode_stats[i];
+        }
+    }
+    if (count == STATS_MAX_OPCODES) {
+        return &opcode_stats[STATS_MAX_OPCODES - 1];
+    }
+
+    pthread_mutex_lock(&opcode_stats_mutex);
+
+    // another thread may have added it
+    count = atomic_load(&opcode_stats_count);
+    int i = 0;
+    while (i < count && strcmp(opcode_stats[i].name, opcode) != 0) {
+        i++;
+    }
+
+    if (i == STATS_MAX_OPCODES) {
+        i = STATS_MAX_OPCODES - 1; // full, use OTHER
+    } else if (i == count) {
+        snprintf(opcode_stats[i].name, STATS_NAME_SIZE, "%s", i == STATS_MAX_OPCODES - 1 ? "OTHER" : opcode);
+        atomic_store(&opcode_stats_count, count + 1);
+    }
+
+    pthread_mutex_unlock(&opcode_stats_mutex);
+    return &opcode_stats[i];
+}
+
+/**
+ * @param nanoseconds
+ * @return the histogram bucket for a call time
+ */
+int stats_bucket(long long nanoseconds) {
+    int bucket = 0;
+    while (nanoseconds > 0 && bucket < STATS_BUCKETS - 1) {
+        nanoseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * add one call to the statistics for an opcode
+ * @param opcode - command or message name
+ * @param nanoseconds - time the call took
+ */
+void statsRecord(const char *opcode, long long nanoseconds) {
+    if (nanoseconds < 0) nanoseconds = 0;
+
+    OpcodeStats *stats = find_stats(opcode);
+    atomic_fetch_add_explicit(&stats->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->total_ns, (uint64_t)nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->buckets[stats_bucket(nanoseconds)], 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&stats->max_ns, memory_order_relaxed);
+    while ((uint64_t)nanoseconds > max &&
+           !atomic_compare_exchange_weak_explicit(&stats->max_ns, &max, (uint64_t)nanoseconds,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    statsCheckSignal();
+}
+
+/**
+ * count an event that has no duration. it is listed with the opcodes with all times 0
+ * @param name
+ */
+void statsCount(const char *name) {
+    statsRecord(name, 0);
+}
+
+/**
+ * approximate latency percentile. the result is the upper limit of the bucket holding the percentile
+ * (but no more than the maximum recorded)
+ * @param stats
+ * @param fraction - 0.5 for the median, 0.99 for the 99th percentile
+ * @return latency in nanoseconds, 0 if there have been no calls
+ */
+uint64_t statsPercentile(OpcodeStats *stats, double fraction) {
+    uint64_t count = atomic_load(&stats->count);
+    if (count == 0) return 0;
+
+    uint64_t target = (uint64_t)(fraction * (double)count + 0.5);
+    if (target < 1) target = 1;
+
+    uint64_t seen = 0;
+    uint64_t max = atomic_load(&stats->max_ns);
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += atomic_load(&stats->buckets[b]);
+        if (seen >= target) {
+            uint64_t limit = (b == 0) ? 0 : ((uint64_t)1 << b) - 1;
+            return (limit < max) ? limit : max;
+        }
+    }
+
+    return max;
+}
+
+/**
+ * write the statistics for every opcode
+ * @param out - e.g. stdout
+ * @param json - true for a JSON object keyed by opcode, false for a text table (times in microseconds)
+ */
+void statsWrite(FILE *out, bool json) {
+    int count = atomic_load(&opcode_stats_count);
+
+    if (json) {
+        fprintf(out, "{");
+    } else {
+        fprintf(out, "%-20s %10s %10s %10s %10s %10s\n", "opcode", "calls", "mean us", "p50 us", "p99 us", "max us");
+    }
+
+    for (int i = 0; i < count; i++) {
+        OpcodeStats *stats = &opcode_stats[i];
+        uint64_t calls = atomic_load(&stats->count);
+        uint64_t mean = calls == 0 ? 0 : atomic_load(&stats->total_ns) / calls;
+        uint64_t p50 = statsPercentile(stats, 0.50);
+        uint64_t p99 = statsPercentile(stats, 0.99);
+        uint64_t max = atomic_load(&stats->max_ns);
+
+        if (json) {
+            fprintf(out, "%s\n  \"%s\": {\"count\": %llu, \"mean_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+                         "\"max_ns\": %llu}", i == 0 ? "" : ",", stats->name, (unsigned long long)calls,
+                    (unsigned long long)mean, (unsigned long long)p50, (unsigned long long)p99,
+                    (unsigned long long)max);
+        } else {
+            fprintf(out, "%-20s %10llu %10.1f %10.1f %10.1f %10.1f\n", stats->name, (unsigned long long)calls,
+                    mean / 1000.0, p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+        }
+    }
+
+    if (json) {
+        fprintf(out, "%s}\n", count == 0 ? "" : "\n");
+    }
+    fflush(out);
+}
+
+/**
+ * clear the statistics for every opcode (the opcodes are kept)
+ */
+void statsReset() {
+    int count = atomic_load(&opcode_stats_count);
+
+    for (int i = 0; i < count; i++) {
+        atomic_store(&opcode_stats[i].count, 0);
+        atomic_store(&opcode_stats[i].total_ns, 0);
+        atomic_store(&opcode_stats[i].max_ns, 0);
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            atomic_store(&opcode_stats[i].buckets[b], 0);
+        }
+    }
+}
+
+/**
+ * signal handler. only sets a flag since it is not safe to write files here
+ * @param signal
+ */
+void stats_signal_handler(int signal) {
+    (void)signal;
+    stats_signalled = 1;
+}
+
+/**
+ * write the statistics when the given signal is received, e.g. kill -USR1 <pid>
+ * @param signal
+ */
+void statsDumpOnSignal(int signal) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stats_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signal, &action, NULL);
+}
+
+/**
+ * write the statistics as text to the console and as JSON to STATS_SIGNAL_FILE
+ * if a signal has been received since the last check
+ */
+void statsCheckSignal() {
+    if (stats_signalled == 0) return;
+    stats_signalled = 0;
+
+    statsWrite(stdout, false);
+
+    FILE *file = fopen(STATS_SIGNAL_FILE, "w");
+    if (file != NULL) {
+        statsWrite(file, true);
+        fclose(file);
+        logAdd(GENERAL, "jni statistics written to " STATS_SIGNAL_FILE);
+    }
+}
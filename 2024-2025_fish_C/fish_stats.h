@@ -0,0 +1,40 @@
+/*
+ * Per opcode latency statistics for the calls made to the JavaFX fish feeder emulator.
+ *
+ * Each opcode (TEXTXY, CLEAR_AREA, BUTTON, RTC_SECOND ...) has a call count and a histogram
+ * of call times. Bucket b counts calls that took less than 2^b nanoseconds (and at least
+ * 2^(b-1)), so recording a call is a few atomic increments and percentiles are accurate
+ * to within a factor of 2. Recording may be done from any thread.
+ */
+#ifndef FISH_STATS_H
+#define FISH_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define STATS_MAX_OPCODES 32 // calls for further opcodes are counted under "OTHER"
+#define STATS_NAME_SIZE 24
+#define STATS_BUCKETS 40 // the last bucket holds every call longer than 2^38ns (about 4.6 minutes)
+
+typedef struct opcodeStats {
+    char name[STATS_NAME_SIZE];
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[STATS_BUCKETS];
+} OpcodeStats;
+
+long long statsNow(); // monotonic clock in nanoseconds, for timing a call
+void statsRecord(const char *opcode, long long nanoseconds); // add one call of the given duration
+void statsCount(const char *name); // count an event that has no duration (e.g. a command that wasn't needed)
+uint64_t statsPercentile(OpcodeStats *stats, double fraction); // approximate latency in ns, fraction 0.0 - 1.0
+void statsWrite(FILE *out, bool json); // write every opcodes count, mean, p50, p99 and max
+void statsReset();
+
+// signals (e.g. SIGUSR1) set a flag, the statistics are then written by the next thread to record a call
+void statsDumpOnSignal(int signal);
+void statsCheckSignal(); // write the statistics if a signal has been received
+
+#endif // FISH_STATS_H
@@ -0,0 +1,404 @@
+/**
+ * Retained menu widgets
+ * see fish_ui.h
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fish.h"
+#include "fish_ui.h"
+#include "fish_fmt.h"
+
+#define UI_CHAR_WIDTH 6
+#define UI_CHAR_HEIGHT 8
+#define UI_TITLE_SIZE 2
+#define UI_LIST_TEXT_INDENT 4 // from the list frame to the item text
+#define UI_PICKER_COLUMNS 3
+#define UI_PICKER_COLUMN_WIDTH 32
+#define UI_PICKER_ROW_HEIGHT 22 // a caption and its value
+#define UI_PICKER_VALUE_OFFSET 11 // from the caption down to the value
+
+/**
+ * @param text
+ * @param size
+ * @return width of the text on the display in pixels
+ */
+int ui_text_width(const char *text, int size) {
+    return (int)strlen(text) * UI_CHAR_WIDTH * size;
+}
+
+/**
+ * draw text, in inverse video if highlighted. displayTextInverse() falls back to a highlight colour on an
+ * emulator that can't invert, leaving the colours white on black as the widgets are drawn
+ * @param x
+ * @param y
+ * @param text
+ * @param size
+ * @param highlighted
+ */
+void ui_text(int x, int y, const char *text, int size, bool highlighted) {
+    if (highlighted) {
+        displayTextInverse(x, y, (char *)text, size);
+    } else {
+        displayText(x, y, (char *)text, size);
+    }
+}
+
+/**
+ * add a widget to a screen
+ * @param screen
+ * @param kind
+ * @param x
+ * @param y
+ * @return the widget, cleared apart from its kind and position. NULL if the screen is full
+ */
+UiWidget *ui_add(UiScreen *screen, enum UiKind kind, int x, int y) {
+    if (screen->count == UI_MAX_WIDGETS) return NULL;
+
+    UiWidget *widget = &screen->widgets[screen->count++];
+    memset(widget, 0, sizeof(*widget));
+    widget->kind = kind;
+    widget->x = x;
+    widget->y = y;
+    widget->size = 1;
+    widget->dirty = true;
+    return widget;
+}
+
+/**
+ * start a screen with no widgets. it is drawn on a cleared display
+ * @param screen
+ */
+void uiInit(UiScreen *screen) {
+    screen->count = 0;
+    screen->invalid = true;
+}
+
+/**
+ * clear the display and redraw every widget at the next paint
+ * @param screen
+ */
+void uiInvalidate(UiScreen *screen) {
+    screen->invalid = true;
+}
+
+/**
+ * draw a label or title, clearing the text it replaces
+ * @param widget
+ */
+void ui_paint_label(UiWidget *widget) {
+    if (widget->shown_width > 0) {
+        displayClearArea(widget->x, widget->y, widget->shown_width, UI_CHAR_HEIGHT * widget->size);
+    }
+    ui_text(widget->x, widget->y, widget->text, widget->size, widget->highlighted);
+    widget->shown_width = ui_text_width(widget->text, widget->size);
+}
+
+/**
+ * draw one visible row of a list
+ * @param widget
+ * @param row - 0 to UI_LIST_ROWS - 1
+ */
+void ui_paint_list_row(UiWidget *widget, int row) {
+    int item = widget->offset + row;
+    int y = widget->y + row * UI_LIST_ROW_HEIGHT;
+
+    if (widget->shown) {
+        displayClearArea(widget->x + 1, y, widget->w - 2, UI_CHAR_HEIGHT);
+    }
+    if (item < widget->count && widget->items != NULL && widget->items[item] != NULL) {
+        ui_text(widget->x + UI_LIST_TEXT_INDENT, y, widget->items[item], 1, item == widget->selected);
+    }
+}
+
+/**
+ * draw a list. if only the selection has changed just the rows it moved between are drawn
+ * @param widget
+ */
+void ui_paint_list(UiWidget *widget) {
+    if (widget->shown && widget->offset == widget->shown_offset) {
+        int rows[2] = {widget->shown_selected - widget->offset, widget->selected - widget->offset};
+        for (int i = 0; i < 2; i++) {
+            if (rows[i] >= 0 && rows[i] < UI_LIST_ROWS && (i == 0 || rows[1] != rows[0])) {
+                ui_paint_list_row(widget, rows[i]);
+            }
+        }
+    } else {
+        if (widget->shown) {
+            displayClearArea(widget->x, widget->y, widget->w, widget->h);
+        }
+        displayLine(widget->x, widget->y, widget->x, widget->y + widget->h - 1);
+        displayLine(widget->x + widget->w - 1, widget->y, widget->x + widget->w - 1, widget->y + widget->h - 1);
+
+        bool shown = widget->shown;
+        widget->shown = false; // the rows don't need clearing
+        for (int row = 0; row < UI_LIST_ROWS; row++) {
+            ui_paint_list_row(widget, row);
+        }
+        widget->shown = shown;
+    }
+
+    widget->shown_selected = widget->selected;
+    widget->shown_offset = widget->offset;
+}
+
+/**
+ * draw the captions of a picker (when it is first drawn) and any values that have changed
+ * @param widget
+ */
+void ui_paint_picker(UiWidget *widget) {
+    for (int i = 0; i < widget->field_count; i++) {
+        UiPickerField *field = &widget->fields[i];
+        int x = widget->x + (i % UI_PICKER_COLUMNS) * UI_PICKER_COLUMN_WIDTH;
+        int y = widget->y + (i / UI_PICKER_COLUMNS) * UI_PICKER_ROW_HEIGHT;
+
+        if (!widget->shown) {
+            ui_text(x, y, field->caption, 1, false);
+            field->shown[0] = '\0';
+        }
+
+        char text[FMT_INT_SIZE];
+        bool highlighted = i == widget->field;
+        if (highlighted) {
+            fmtInt(text, sizeof(text), widget->editing);
+        } else {
+            fmtIntWidth(text, sizeof(text), field->value, field->pad ? 2 : 0, '0');
+        }
+
+        if (strcmp(text, field->shown) != 0 || highlighted != field->shown_highlighted) {
+            if (field->shown[0] != '\0') {
+                displayClearArea(x, y + UI_PICKER_VALUE_OFFSET, ui_text_width(field->shown, 1), UI_CHAR_HEIGHT);
+            }
+            ui_text(x, y + UI_PICKER_VALUE_OFFSET, text, 1, highlighted);
+            strcpy(field->shown, text);
+            field->shown_highlighted = highlighted;
+        }
+    }
+}
+
+/**
+ * draw the widgets that have changed, or all of them on a cleared display if the screen is invalid
+ * @param screen
+ * @return the number of widgets drawn
+ */
+int uiPaint(UiScreen *screen) {
+    int painted = 0;
+
+    if (screen->invalid) {
+        displayColour("white", "black");
+        displayClear();
+        for (int i = 0; i < screen->count; i++) {
+            screen->widgets[i].shown = false;
+            screen->widgets[i].shown_width = 0;
+            screen->widgets[i].dirty = true;
+        }
+        screen->invalid = false;
+    }
+
+    for (int i = 0; i < screen->count; i++) {
+        UiWidget *widget = &screen->widgets[i];
+        if (!widget->dirty) continue;
+
+        if (painted == 0) {
+            displayColour("white", "black");
+        }
+
+        switch (widget->kind) {
+            case UiLabel:
+            case UiTitle:
+                ui_paint_label(widget);
+                break;
+            case UiRule:
+                displayLine(widget->x, widget->y, widget->x + widget->w - 1, widget->y);
+                break;
+            case UiList:
+                ui_paint_list(widget);
+                break;
+            case UiPicker:
+                ui_paint_picker(widget);
+                break;
+        }
+
+        widget->dirty = false;
+        widget->shown = true;
+        painted++;
+    }
+
+    return painted;
+}
+
+/**
+ * @param screen
+ * @param x - top left
+ * @param y
+ * @param text
+ * @param size - text size
+ * @return a text label
+ */
+UiWidget *uiLabel(UiScreen *screen, int x, int y, const char *text, int size) {
+    UiWidget *widget = ui_add(screen, UiLabel, x, y);
+    if (widget != NULL) {
+        fmtText(widget->text, UI_TEXT_SIZE, "%s", text);
+        widget->size = size;
+    }
+    return widget;
+}
+
+/**
+ * @param screen
+ * @param text
+ * @return a title across the top of the display
+ */
+UiWidget *uiTitle(UiScreen *screen, const char *text) {
+    UiWidget *widget = uiLabel(screen, 0, 0, text, UI_TITLE_SIZE);
+    if (widget != NULL) {
+        widget->kind = UiTitle;
+    }
+    return widget;
+}
+
+/**
+ * @param screen
+ * @param x - left end
+ * @param y
+ * @param w - length in pixels
+ * @return a horizontal line
+ */
+UiWidget *uiRule(UiScreen *screen, int x, int y, int w) {
+    UiWidget *widget = ui_add(screen, UiRule, x, y);
+    if (widget != NULL) {
+        widget->w = w;
+        widget->h = 1;
+    }
+    return widget;
+}
+
+/**
+ * @param screen
+ * @param x - left of the frame
+ * @param y - top of the first row
+ * @param w - width including the frame
+ * @param items - text of each item. the list keeps the pointer, call uiListItems() if the items change
+ * @param count
+ * @return a framed list showing UI_LIST_ROWS items at a time, the first item selected
+ */
+UiWidget *uiList(UiScreen *screen, int x, int y, int w, char **items, int count) {
+    UiWidget *widget = ui_add(screen, UiList, x, y);
+    if (widget != NULL) {
+        widget->w = w;
+        widget->h = UI_LIST_ROWS * UI_LIST_ROW_HEIGHT - 1;
+        widget->items = items;
+        widget->count = count;
+    }
+    return widget;
+}
+
+/**
+ * @param screen
+ * @param x - left of the first field
+ * @param y - top of the first row of captions
+ * @param captions - caption of each field
+ * @param count - number of fields, at most UI_PICKER_FIELDS
+ * @param pad - show values below 10 with a leading 0
+ * @return number picker with every value 0 and the first field selected
+ */
+UiWidget *uiPicker(UiScreen *screen, int x, int y, char **captions, int count, bool pad) {
+    UiWidget *widget = ui_add(screen, UiPicker, x, y);
+    if (widget != NULL) {
+        widget->field_count = count < UI_PICKER_FIELDS ? count : UI_PICKER_FIELDS;
+        for (int i = 0; i < widget->field_count; i++) {
+            fmtText(widget->fields[i].caption, UI_TEXT_SIZE, "%s", captions[i]);
+            widget->fields[i].pad = pad;
+        }
+    }
+    return widget;
+}
+
+/**
+ * change the text of a label or title
+ * @param widget
+ * @param text
+ */
+void uiSetText(UiWidget *widget, const char *text) {
+    if (widget == NULL || strncmp(widget->text, text, UI_TEXT_SIZE - 1) == 0) return;
+
+    fmtText(widget->text, UI_TEXT_SIZE, "%s", text);
+    widget->dirty = true;
+}
+
+/**
+ * show a label or title inverted
+ * @param widget
+ * @param highlighted
+ */
+void uiSetHighlighted(UiWidget *widget, bool highlighted) {
+    if (widget == NULL || widget->highlighted == highlighted) return;
+
+    widget->highlighted = highlighted;
+    widget->dirty = true;
+}
+
+/**
+ * select a list item, scrolling so that it is visible
+ * @param widget
+ * @param index - item to select. past the last item goes back to the first
+ * @return the item selected
+ */
+int uiListSelect(UiWidget *widget, int index) {
+    if (widget == NULL) return index;
+    if (index >= widget->count || index < 0) index = 0;
+
+    int offset = widget->offset;
+    if (index < offset) offset = index;
+    if (index >= offset + UI_LIST_ROWS) offset = index - UI_LIST_ROWS + 1;
+
+    if (index != widget->selected || offset != widget->offset) {
+        widget->selected = index;
+        widget->offset = offset;
+        widget->dirty = true;
+    }
+    return index;
+}
+
+/**
+ * the items of a list have changed
+ * @param widget
+ * @param items
+ * @param count
+ */
+void uiListItems(UiWidget *widget, char **items, int count) {
+    if (widget == NULL) return;
+
+    widget->items = items;
+    widget->count = count;
+    widget->shown_offset = -1; // every row may have changed
+    widget->dirty = true;
+}
+
+/**
+ * set the value a picker field shows when it isn't selected
+ * @param widget
+ * @param field
+ * @param value
+ */
+void uiPickerValue(UiWidget *widget, int field, int value) {
+    if (widget == NULL || field < 0 || field >= widget->field_count || widget->fields[field].value == value) return;
+
+    widget->fields[field].value = value;
+    widget->dirty = true;
+}
+
+/**
+ * select a picker field and show the value being edited in it
+ * @param widget
+ * @param field - past the last field for none
+ * @param editing
+ */
+void uiPickerEdit(UiWidget *widget, int field, int editing) {
+    if (widget == NULL || (widget->field == field && widget->editing == editing)) return;
+
+    widget->field = field;
+    widget->editing = editing;
+    widget->dirty = true;
+}
@@ -0,0 +1,87 @@
+/*
+ * Retained widgets for the menus: labels, title bars, horizontal rules, scrolling lists and number pickers.
+ *
+ * A screen keeps its widgets between passes of the menu loop. Changing a widget (its text, the selected
+ * list item, a picker value) marks it dirty only if something is different, and uiPaint() redraws just the
+ * dirty widgets, clearing the area they covered first. Lists redraw only the rows whose selection changed
+ * and pickers only the fields whose text changed. A screen is redrawn completely when it is first painted
+ * and after uiInvalidate() (e.g. when something else has drawn over it or cleared the display).
+ *
+ * The widgets draw with the fish.h display functions so they work with either backend.
+ */
+#ifndef FISH_UI_H
+#define FISH_UI_H
+
+#include <stdbool.h>
+
+#define UI_MAX_WIDGETS 16
+#define UI_TEXT_SIZE 48
+#define UI_PICKER_FIELDS 6
+#define UI_LIST_ROWS 5 // rows of a list visible at once
+#define UI_LIST_ROW_HEIGHT 11
+
+enum UiKind {UiLabel, UiTitle, UiRule, UiList, UiPicker};
+
+typedef struct uiPickerField {
+    char caption[UI_TEXT_SIZE];
+    int value;
+    bool pad; // show values below 10 with a leading 0
+    char shown[UI_TEXT_SIZE]; // value text on the display, "" if not drawn
+    bool shown_highlighted;
+} UiPickerField;
+
+typedef struct uiWidget {
+    enum UiKind kind;
+    int x, y; // top left
+    int w, h; // rules and lists. labels and titles use the width of their text
+    int size; // text size
+    bool dirty; // needs redrawing
+    bool shown; // has been drawn since the screen was last cleared
+
+    // labels and titles
+    char text[UI_TEXT_SIZE];
+    bool highlighted;
+    int shown_width; // width of the text on the display, cleared before redrawing
+
+    // lists
+    char **items;
+    int count;
+    int selected; // item, count or more for none
+    int offset; // first item visible
+    int shown_selected;
+    int shown_offset;
+
+    // pickers. the selected field shows the value being edited, highlighted
+    UiPickerField fields[UI_PICKER_FIELDS];
+    int field_count;
+    int field;
+    int editing;
+} UiWidget;
+
+typedef struct uiScreen {
+    UiWidget widgets[UI_MAX_WIDGETS];
+    int count;
+    bool invalid; // the whole display must be redrawn
+} UiScreen;
+
+void uiInit(UiScreen *screen); // no widgets. the first paint clears the display
+void uiInvalidate(UiScreen *screen); // clear and redraw everything at the next paint
+int uiPaint(UiScreen *screen); // redraw what has changed. returns the number of widgets drawn
+
+// add widgets. each returns NULL if the screen is full
+UiWidget *uiLabel(UiScreen *screen, int x, int y, const char *text, int size);
+UiWidget *uiTitle(UiScreen *screen, const char *text); // large text at the top of the display
+UiWidget *uiRule(UiScreen *screen, int x, int y, int w); // horizontal line
+UiWidget *uiList(UiScreen *screen, int x, int y, int w, char **items, int count); // framed, UI_LIST_ROWS high
+// fields are laid out 3 to a row, each a caption with its value below
+UiWidget *uiPicker(UiScreen *screen, int x, int y, char **captions, int count, bool pad);
+
+// change widgets. they are only marked dirty if something changes
+void uiSetText(UiWidget *widget, const char *text);
+void uiSetHighlighted(UiWidget *widget, bool highlighted);
+int uiListSelect(UiWidget *widget, int index); // scrolls to show it. returns the index, wrapped to 0 at the end
+void uiListItems(UiWidget *widget, char **items, int count); // the items or their text have changed
+void uiPickerValue(UiWidget *widget, int field, int value); // the value shown when the field isn't selected
+void uiPickerEdit(UiWidget *widget, int field, int editing); // select a field and show the value being edited
+
+#endif // FISH_UI_H
@@ -9,6 +9,9 @@
 #include <_cygwin.h>
 
 #include "fish.h"
+#include "fish_ui.h"
+#include "fish_fmt.h"
+#include "fish_hud.h"
 //#include "fish.c"
 
 /**
@@ -38,6 +41,8 @@
 
 #define COOLDOWN_TIME 60
 #define TIMEOUT_TIME 60
+#define DIM_TIME 30 //Seconds without a press before the screen is dimmed, it is turned off after TIMEOUT_TIME
+#define SCREEN_OFF_WAIT 1000 //Milliseconds the menu loop waits for a press while the screen is off
 #define ROTATION_SPEED 55 //The value stands for the milliseconds that we will be waiting between each motor step. At 55 the speed is at a maximum as the feeder will take 20s to feed
 #define LARGEST_ROTATION_SPEED 100
 
@@ -64,6 +69,82 @@ typedef struct clockStruct {
     int year;
 } ClockTime;
 
+//Menu resources prepared by menuPrepare() while the emulator GUI is starting
+int preparedNumLines = 0; //Size of the feed schedule file in terms of lines
+char **preparedTimesList = NULL; //The feed schedule as strings for the date viewing menu
+char **preparedOptions = NULL; //Option mode menu items
+char **preparedUtilities = NULL; //Utility mode menu items
+
+//The widgets of the menu currently on screen. They are kept between passes of the menu loop and only redrawn when they change
+UiScreen menuScreen;
+int menuScreenId = CLOSE_MENUS - 1; //Id of the menu the widgets belong to
+
+//Debug overlay with the frame rate, display commands and jni calls per frame and the menu loop time. It is turned
+// on by the "Debug overlay" utility or at startup with the FISH_HUD environment variable (see fish_hud.h)
+Hud menuHud;
+
+/**
+ * Allocate a menu item list of the given size with each item copied from items (or set to "1" if items is NULL)
+ * @param items the text for each item, or NULL
+ * @param size number of items
+ * @return the list
+ */
+char **buildMenuItems(char **items, int size) {
+    //Borrowed from the website geeksforgeeks.org for how to malloc an array of strings
+    char **itemsPtr = (char**)malloc(size * sizeof(char*));
+    if (itemsPtr == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    for (int i = 0; i < size; i++) {
+        itemsPtr[i] = (char*)malloc(20 * sizeof(char));
+
+        if (itemsPtr[i] == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+        }else {
+            sprintf(itemsPtr[i], "%s", items != NULL ? items[i] : "1");
+        }
+    }
+
+    return itemsPtr;
+}
+
+/**
+ * Load the feed schedule and build the menu item lists. This runs in parallel with the JVM and GUI starting
+ * (see jniPrepare()) so it must not use the emulator functions
+ */
+void menuPrepare() {
+    char* modeOptions[5] = {"Paused", "Auto", "Feed now", "Skip next", "Back"};
+    //I've left a lot of room for adding extra utility
+    char* utilityOptions[5] = {"Speed control", "Display times", "Set clock", "Debug overlay", ""};
+
+    preparedOptions = buildMenuItems(modeOptions, 5);
+    preparedUtilities = buildMenuItems(utilityOptions, 5);
+
+    //The feed schedule file is read here instead of when the menus start
+    preparedNumLines = howManyLinesInFile(FILE_TO_WRITE_TO) + 1;
+    preparedTimesList = buildMenuItems(NULL, preparedNumLines);
+    if (preparedTimesList != NULL) {
+        getAllDatesFromFileAsString(preparedTimesList, FILE_TO_WRITE_TO);
+    }
+}
+
+/**
+ * Start a new screen of widgets if a different menu is being shown
+ * @param id the menu's id
+ * @return true if the menu must add its widgets to menuScreen
+ */
+bool menuBuild(int id) {
+    if (id == menuScreenId) {
+        return false;
+    }
+
+    uiInit(&menuScreen);
+    menuScreenId = id;
+    return true;
+}
+
 /**
  * the function that is the entry point for the fish feeder C program main logic
  * it is called by jniSetup() from main, once the GUI thread has been initialised.
@@ -73,25 +154,23 @@ typedef struct clockStruct {
  */
 
 int setClockMenu(int *currentTSI, int *currentTSV, ClockTime *clockTimeValsToSave, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
-
-    //Here you can manually set the number of variables you would like to use to be able to specify the new clock time
-    int numValsInClockSetter = 6;
+    static UiWidget *picker;
 
-    displayText(0, 0, "Set clock menu:", 1);
+    if (menuBuild(SET_CLOCK_MENU_ID)) {
+        char *valuePurposes[NUMBER_OF_CLOCK_SET_ITEMS] = {"sec", "min", "hour", "day", "month", "year"};
 
-    displayDefaultClockValues(SCREEN_WIDTH, SCREEN_HEIGHT, numValsInClockSetter, clockTimeValsToSave);
-    displayNumberPicker(SCREEN_WIDTH, SCREEN_HEIGHT, currentTSI, currentTSV);
+        uiLabel(&menuScreen, 0, 0, "Set clock menu:", 1);
+        picker = uiPicker(&menuScreen, SCREEN_WIDTH / 8, SCREEN_HEIGHT / 6, valuePurposes, NUMBER_OF_CLOCK_SET_ITEMS, true);
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*currentTSV)++;
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
 
         //The arduous checking the value of i is unfortunately necessary due to the nature of a struct, only being able to access the variables inside
@@ -114,6 +193,14 @@ int setClockMenu(int *currentTSI, int *currentTSV, ClockTime *clockTimeValsToSav
         *currentTSV = 0;
     }
 
+    uiPickerValue(picker, 0, clockTimeValsToSave->second);
+    uiPickerValue(picker, 1, clockTimeValsToSave->minute);
+    uiPickerValue(picker, 2, clockTimeValsToSave->hour);
+    uiPickerValue(picker, 3, clockTimeValsToSave->day);
+    uiPickerValue(picker, 4, clockTimeValsToSave->month);
+    uiPickerValue(picker, 5, clockTimeValsToSave->year);
+    uiPickerEdit(picker, *currentTSI, *currentTSV);
+
     if (*currentTSI >= NUMBER_OF_CLOCK_SET_ITEMS) {
         //Setting the clock to what the user requested
         clockSet(clockTimeValsToSave->second, clockTimeValsToSave->minute, clockTimeValsToSave->hour, clockTimeValsToSave->day, clockTimeValsToSave->month, clockTimeValsToSave->year);
@@ -133,27 +220,25 @@ int setClockMenu(int *currentTSI, int *currentTSV, ClockTime *clockTimeValsToSav
     return SET_CLOCK_MENU_ID;
 }
 
-int displayTimesMenu(char **timesListPtr, int *rangeIndex, int size, int *scrollOffset, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
+int displayTimesMenu(char **timesListPtr, int *rangeIndex, int size, int *timeOutCounter) {
+    static UiWidget *list;
 
-    displayText(0, 0, "Feed times:", 1);
-
-    char *result = buttonState();
+    if (menuBuild(DISPLAY_TIMES_MENU_ID)) {
+        uiLabel(&menuScreen, 0, 0, "Feed times:", 1);
+        list = uiList(&menuScreen, SCREEN_WIDTH / 32, SCREEN_HEIGHT / 6, (15 * SCREEN_WIDTH) / 16 + 1, timesListPtr, size);
+    }
 
-    displayScroller(timesListPtr, rangeIndex, SCREEN_WIDTH, SCREEN_HEIGHT, size, scrollOffset);
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*rangeIndex)++;
-
-        //5 is the limit for the number of items to be displayed on screen
-        if (*rangeIndex >= 5) {
-            (*scrollOffset)++;
-        }
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    //The list goes back to the first time after the last one and scrolls to keep the selected time on screen
+    *rangeIndex = uiListSelect(list, *rangeIndex);
+
+    if (result == LongPress) {
         *timeOutCounter = 0;
 
         if (timesListPtr != NULL) {
@@ -162,6 +247,7 @@ int displayTimesMenu(char **timesListPtr, int *rangeIndex, int size, int *scroll
 
         //To sync what is now saved in the file with the systems copy of the feed schedule we must clear and reload timesListPtr
         getAllDatesFromFileAsString(timesListPtr, FILE_TO_WRITE_TO);
+        uiListItems(list, timesListPtr, size);
 
         return MAIN_MENU_ID;
     }
@@ -170,22 +256,19 @@ int displayTimesMenu(char **timesListPtr, int *rangeIndex, int size, int *scroll
 }
 
 int speedMenu(int *timeOutCounter, int *rotationSpeed) {
-    displayClear();
-    displayColour("white", "black");
-
-    displayText(0, SCREEN_HEIGHT / 8, "Motor speed:", 1);
+    static UiWidget *picker;
 
-    //There will only ever be one number to pick in this menu so it will only ever be zero hence all of this trouble to make
-    int *zero = malloc(sizeof(int));
-    *zero = 0;
+    if (menuBuild(SPEED_MENU_ID)) {
+        //There will only ever be one number to pick in this menu and it doesn't need a caption
+        char *valuePurposes[1] = {""};
 
-    displayNumberPicker(SCREEN_WIDTH, SCREEN_HEIGHT, zero, rotationSpeed);
-
-    free(zero);
+        uiLabel(&menuScreen, 0, SCREEN_HEIGHT / 8, "Motor speed:", 1);
+        picker = uiPicker(&menuScreen, SCREEN_WIDTH / 8, SCREEN_HEIGHT / 6, valuePurposes, 1, false);
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*rotationSpeed)++;
 
@@ -194,7 +277,9 @@ int speedMenu(int *timeOutCounter, int *rotationSpeed) {
         }
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    uiPickerEdit(picker, 0, *rotationSpeed);
+
+    if (result == LongPress) {
         *timeOutCounter = 0;
 
         return MAIN_MENU_ID;
@@ -203,29 +288,31 @@ int speedMenu(int *timeOutCounter, int *rotationSpeed) {
     return SPEED_MENU_ID;
 }
 
-int utilityMenu(int *rangeIndex, char **utilityPtr, int *scrollOffset, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
+int utilityMenu(int *rangeIndex, char **utilityPtr, int *timeOutCounter) {
+    static UiWidget *list;
 
     //Getting the size of the utilityOptions array
-    int modeSize = 3;
+    int modeSize = 4;
 
     //The main menu and the option menu are not included in the menuOptions char* array
 
-    //Display menu description
-    displayText(SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "Utility menu", 1);
-
-    displayScroller(utilityPtr, rangeIndex, SCREEN_WIDTH, SCREEN_HEIGHT, modeSize, scrollOffset);
+    if (menuBuild(UTILITY_MENU_ID)) {
+        //Display menu description
+        uiLabel(&menuScreen, SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "Utility menu", 1);
+        list = uiList(&menuScreen, SCREEN_WIDTH / 32, SCREEN_HEIGHT / 6, (15 * SCREEN_WIDTH) / 16 + 1, utilityPtr, modeSize);
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*rangeIndex)++;
     }
 
+    *rangeIndex = uiListSelect(list, *rangeIndex);
+
     //The user has selected this mode option
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
 
         switch (*rangeIndex) {
@@ -238,37 +325,43 @@ int utilityMenu(int *rangeIndex, char **utilityPtr, int *scrollOffset, int *time
             case 2:
                 return SET_CLOCK_MENU_ID;
             break;
+            case 3:
+                hudEnable(&menuHud, menuHud.where == HUD_OFF ? HUD_DISPLAY : HUD_OFF);
+                return MAIN_MENU_ID;
+            break;
             default:
                 return MAIN_MENU_ID;
             break;
         }
     }
 
-    free(result);
-
     return UTILITY_MENU_ID;
 }
 
 int dateSetMenu(int *currentTSI, int *currentTSV, FeedTime *feedTimeValsToSave, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
+    static UiWidget *picker;
 
-    //Display menu description
-    displayText(SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "date set menu", 1);
+    if (menuBuild(DATE_SET_MENU_ID)) {
+        char *valuePurposes[NUMBER_OF_DATE_SET_ITEMS] = {"hours", "mins", "rotations"};
 
-    displayDefaultDateValues(SCREEN_WIDTH, SCREEN_HEIGHT, NUMBER_OF_DATE_SET_ITEMS, feedTimeValsToSave);
+        //Display menu description
+        uiLabel(&menuScreen, SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "date set menu", 1);
+        picker = uiPicker(&menuScreen, SCREEN_WIDTH / 8, SCREEN_HEIGHT / 6, valuePurposes, NUMBER_OF_DATE_SET_ITEMS, true);
 
-    //Just displays and highlights the number the user is currently trying to transform
-    displayNumberPicker(SCREEN_WIDTH, SCREEN_HEIGHT, currentTSI, currentTSV);
+        //The number of rotations isn't a time so it has no leading 0
+        if (picker != NULL) {
+            picker->fields[2].pad = false;
+        }
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*currentTSV)++;
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
         if (*currentTSI == 0) {
             feedTimeValsToSave->hour = *currentTSV;
@@ -284,7 +377,11 @@ int dateSetMenu(int *currentTSI, int *currentTSV, FeedTime *feedTimeValsToSave,
 
     boundTimeVals(currentTSI, currentTSV);
 
-    free(result);
+    //Just highlights the number the user is currently trying to transform next to the values already picked
+    uiPickerValue(picker, 0, feedTimeValsToSave->hour);
+    uiPickerValue(picker, 1, feedTimeValsToSave->minute);
+    uiPickerValue(picker, 2, feedTimeValsToSave->numRots);
+    uiPickerEdit(picker, *currentTSI, *currentTSV);
 
     //If the user is finished setting their new feed time
     if (*currentTSI >= NUMBER_OF_DATE_SET_ITEMS) {
@@ -311,22 +408,23 @@ int dateSetMenu(int *currentTSI, int *currentTSV, FeedTime *feedTimeValsToSave,
  * @param timeOutCounter
  * @return
  */
-int operatingModeMenu(enum ModeOption *currentModePtr, int *rangeIndex, char **optionPtr, int *scrollOffset, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
+int operatingModeMenu(enum ModeOption *currentModePtr, int *rangeIndex, char **optionPtr, int *timeOutCounter) {
+    static UiWidget *list;
 
     //Getting the size of the modeOptions array
     int modeSize = 5;
 
-    //Display menu description
-    displayText(SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "Op mode menu", 1);
+    if (menuBuild(OPERATING_MODE_MENU_ID)) {
+        //Display menu description
+        uiLabel(&menuScreen, SCREEN_WIDTH / 16, SCREEN_HEIGHT / 64, "Op mode menu", 1);
 
-    //const char* modeOptions[5] = {"Paused", "Auto", "Feed now", "Skip next", "Back"};
-    displayScroller(optionPtr, rangeIndex, SCREEN_WIDTH, SCREEN_HEIGHT, modeSize, scrollOffset);
+        //const char* modeOptions[5] = {"Paused", "Auto", "Feed now", "Skip next", "Back"};
+        list = uiList(&menuScreen, SCREEN_WIDTH / 32, SCREEN_HEIGHT / 6, (15 * SCREEN_WIDTH) / 16 + 1, optionPtr, modeSize);
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*rangeIndex)++;
 
@@ -337,51 +435,42 @@ int operatingModeMenu(enum ModeOption *currentModePtr, int *rangeIndex, char **o
         printf("\n");
     }
 
+    *rangeIndex = uiListSelect(list, *rangeIndex);
+
     //The user has selected this mode option
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
         *currentModePtr = *rangeIndex;
 
         return MAIN_MENU_ID;
     }
 
-    free(result);
-
     return OPERATING_MODE_MENU_ID;
 }
 
 int feedMenu(enum ModeOption *currentModePtr, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
-
-    char* title = malloc(20 * sizeof(char));
-    sprintf(title, "%s", "Feedey boy");
-
     logAdd(GENERAL, "feed menu");
     printf("Long press the button to feed, short press to exit\n");
 
-    displayText(0,0, title, 2);
-
-    displayColour( "black", "white");
-    displayText(0,CHAR_HEIGHT*4, "Manual feed", 1);
-    displayColour("white", "black"); // JavaFX display. white text on black background
-    displayText(0,CHAR_HEIGHT*7, "Exit", 1);
+    if (menuBuild(FEED_MENU_ID)) {
+        uiTitle(&menuScreen, "Feedey boy");
+        uiSetHighlighted(uiLabel(&menuScreen, 0, CHAR_HEIGHT*4, "Manual feed", 1), true);
+        uiLabel(&menuScreen, 0, CHAR_HEIGHT*7, "Exit", 1);
+    }
 
-    char *result = buttonState(); // get the button state from the JavaFX application
+    enum ButtonEvent result = buttonPollEvent(); // get the next button press from the JavaFX application
 
-    if (strcmp(result, "SHORT_PRESS") == 0){
+    if (result == ShortPress){
         *timeOutCounter = 0;
         return MAIN_MENU_ID;
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0){
+    if (result == LongPress){
         *timeOutCounter = 0;
         *currentModePtr = FeedNow;
         return MAIN_MENU_ID;
     }
 
-    free(result);
-
     return FEED_MENU_ID;
 }
 
@@ -390,32 +479,33 @@ int feedMenu(enum ModeOption *currentModePtr, int *timeOutCounter) {
  * hence them being 'options'.
  */
 int optionMenu(int *menuIndex, int *timeOutCounter) {
-    displayClear();
-    displayColour("white", "black");
+    static UiWidget *option;
 
     //The main menu and the option menu are not included in the menuOptions char* array
     char *menuOptions[5] = {"Feed", "Utility", "dateSet", "Op mode", "Back"};
 
-    //Instructions for the user to travers the options menu are displayed
-    displayText(0, 0, "SHORT press to navigate, LONG to select", 1);
+    if (menuBuild(OPTIONS_MENU_ID)) {
+        //Instructions for the user to travers the options menu are displayed
+        uiLabel(&menuScreen, 0, 0, "SHORT press to navigate, LONG to select", 1);
+        option = uiLabel(&menuScreen, SCREEN_WIDTH/4, SCREEN_HEIGHT/4, "", 2);
+    }
 
-    char *result = buttonState();
+    enum ButtonEvent result = buttonPollEvent();
 
     //If the menu index has gone outside the range of the list then loop the value back round to 0
     if (*menuIndex > 4) {
         *menuIndex = 0;
     }
 
-    //Displays the new text to say what option you are currently selecting and removes the text from the previous option
-    displayClearArea(SCREEN_WIDTH/4, SCREEN_HEIGHT/4, SCREEN_WIDTH, SCREEN_HEIGHT/4);
-    displayText(SCREEN_WIDTH/4, SCREEN_HEIGHT/4, menuOptions[*menuIndex], 2);
+    //Displays the new text to say what option you are currently selecting, the label removes the text of the previous option
+    uiSetText(option, menuOptions[*menuIndex]);
 
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         (*menuIndex)++;
     }
 
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
         switch (*menuIndex) {
             case 0:
@@ -433,8 +523,6 @@ int optionMenu(int *menuIndex, int *timeOutCounter) {
         }
     }
 
-    free(result);
-
     return OPTIONS_MENU_ID;
 }
 
@@ -446,49 +534,55 @@ int optionMenu(int *menuIndex, int *timeOutCounter) {
  * @return
  */
 int mainMenu(char *title, char *currentMode, int *numOfFeeds, char *nextFeedTime, int *timeOutCounter) {
-    // output banner (see fish.h for details)
-    displayColour("white", "black");
-    displayClear();
-    displayTitle(title);
+    static UiWidget *timeLabel, *nextFeedLabel, *numFeedsLabel, *modeLabel;
+
+    if (menuBuild(MAIN_MENU_ID)) {
+        // output banner (see fish.h for details)
+        uiTitle(&menuScreen, title);
+
+        // display graphic lines around time
+        uiRule(&menuScreen, 0, SCREEN_HEIGHT - 1, SCREEN_WIDTH);
+        uiRule(&menuScreen, 0, SCREEN_HEIGHT - CHAR_HEIGHT*2-1, SCREEN_WIDTH);
+
+        timeLabel = uiLabel(&menuScreen, SCREEN_WIDTH/2-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*1.5, "", 1);
+        nextFeedLabel = uiLabel(&menuScreen, SCREEN_WIDTH/1.5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*3.5, "", 1);
+        numFeedsLabel = uiLabel(&menuScreen, SCREEN_WIDTH/1.5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*5, "", 1);
+        modeLabel = uiLabel(&menuScreen, SCREEN_WIDTH/5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*3.5, "", 1);
+    }
 
     // display console message
     printf("Long press the button to quit, short press to enter menu\n");
 
-    // display graphic lines around time
-    displayColour("white", "black");
-    displayLine(0, SCREEN_HEIGHT - 1, SCREEN_WIDTH, SCREEN_HEIGHT - 1);
-    displayLine(0, SCREEN_HEIGHT - CHAR_HEIGHT*2-1, SCREEN_WIDTH, SCREEN_HEIGHT - CHAR_HEIGHT*2-1);
-
     // display the time value
-    char time[LINE_SIZE];
-    snprintf(time, LINE_SIZE, "%02i-%02i-%02i", clockHour(), clockMinute(), clockSecond());
-    displayText(SCREEN_WIDTH/2-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*1.5, time, 1);
+    char time[FMT_TIME_SIZE];
+    fmtTime(time, sizeof(time), clockHour(), clockMinute(), clockSecond(), '-');
+    uiSetText(timeLabel, time);
 
     //Display the next scheduled feed time
-    displayText(SCREEN_WIDTH/1.5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*3.5, nextFeedTime, 1);
+    uiSetText(nextFeedLabel, nextFeedTime);
 
     //Display the number of feeds since the automatic feeding schedule started
-    displayNumberOfFeeds(SCREEN_WIDTH/1.5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*5, *numOfFeeds, 1);
+    char numFeeds[LINE_SIZE];
+    fmtText(numFeeds, LINE_SIZE, "No. feeds:%d", *numOfFeeds);
+    uiSetText(numFeedsLabel, numFeeds);
 
     //Display the feeder operating mode
-    displayText(SCREEN_WIDTH/5-4*CHAR_WIDTH, SCREEN_HEIGHT-CHAR_HEIGHT*3.5, currentMode, 1);
+    uiSetText(modeLabel, currentMode);
 
-    char *result = buttonState(); // get the button state from the JavaFX application
+    enum ButtonEvent result = buttonPollEvent(); // get the next button press from the JavaFX application
 
     //Check the result and close the menu system if the button is short pressed
-    if (strcmp(result, "LONG_PRESS") == 0) {
+    if (result == LongPress) {
         *timeOutCounter = 0;
         return CLOSE_MENUS;
     }
 
     // check the result and quit this look if the button is short pressed
-    if (strcmp(result, "SHORT_PRESS") == 0) {
+    if (result == ShortPress) {
         *timeOutCounter = 0;
         return OPTIONS_MENU_ID;
     }
 
-    free(result);
-
     logAdd(METHOD_ENTRY, "userProcessing() done");
 
     return MAIN_MENU_ID;
@@ -499,7 +593,7 @@ void menuSelector() {
 
     //Size of the feed schedule file in terms of lines
     int *numLinesInFeedFile = malloc(sizeof(int));
-    *numLinesInFeedFile = howManyLinesInFile(FILE_TO_WRITE_TO) + 1;
+    *numLinesInFeedFile = preparedNumLines;
 
     //General setup for all menu functions
     //Allocate the string for the title memory and write to it
@@ -520,24 +614,8 @@ void menuSelector() {
     int *rangeIndexOp = malloc(sizeof(int));
     *rangeIndexOp = 0;
 
-    //OPTION MODE MENU
-    char* modeOptions[5] = {"Paused", "Auto", "Feed now", "Skip next", "Back"};
-
-    //Borrowed from the website geeksforgeeks.org for how to malloc an array of strings
-    char **optionPtr = (char**)malloc(5 * sizeof(char*));
-    if (optionPtr == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-    }
-
-    for (int i = 0; i < 5; i++) {
-        optionPtr[i] = (char*)malloc(20 * sizeof(char));
-
-        if (optionPtr[i] == NULL) {
-            fprintf(stderr, "Memory allocation error\n");
-        }else {
-            sprintf(optionPtr[i], "%s", modeOptions[i]);
-        }
-    }
+    //OPTION MODE MENU (built by menuPrepare())
+    char **optionPtr = preparedOptions;
 
     //DATE SET DATA:
     FeedTime *feedValuesToSave = malloc(sizeof(FeedTime));
@@ -562,46 +640,14 @@ void menuSelector() {
     int *currentClockSelectorValue = malloc(sizeof(int));
     *currentClockSelectorValue = 0;
 
-    //UTILITY MODE MENU
-    //I've left a lot of room for adding extra utility
-    char* utilityOptions[3] = {"Speed control", "Display times", "Set clock"};
-
+    //UTILITY MODE MENU (built by menuPrepare())
     int *rangeIndexUt = malloc(sizeof(int));
     *rangeIndexUt = 0;
 
-    char **utilityPtr = (char**)malloc(5 * sizeof(char*));
-    if (utilityPtr == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-    }
-
-    for (int i = 0; i < 5; i++) {
-        utilityPtr[i] = (char*)malloc(20 * sizeof(char));
-
-        if (utilityPtr[i] == NULL) {
-            fprintf(stderr, "Memory allocation error\n");
-        }else {
-            sprintf(utilityPtr[i], "%s", utilityOptions[i]);
-        }
-    }
+    char **utilityPtr = preparedUtilities;
 
-    //DATE VIEWING MENU
-    char **timesListPtr = (char**)malloc(*numLinesInFeedFile * sizeof(char*));
-    if (timesListPtr == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-    }
-
-    for (int i = 0; i < *numLinesInFeedFile; i++) {
-        timesListPtr[i] = (char*)malloc(20 * sizeof(char));
-
-        if (timesListPtr[i] == NULL) {
-            fprintf(stderr, "Memory allocation error\n");
-        }else {
-            sprintf(timesListPtr[i], "%s", "1");
-            printf("%s\n", timesListPtr[i]);
-        }
-    }
-
-    getAllDatesFromFileAsString(timesListPtr, FILE_TO_WRITE_TO);
+    //DATE VIEWING MENU (the feed schedule is loaded by menuPrepare())
+    char **timesListPtr = preparedTimesList;
 
     int *rangeIndexDa = malloc(sizeof(int));
     *rangeIndexDa = 0;
@@ -609,7 +655,7 @@ void menuSelector() {
     //Ptr to the next time that the feeder will feed and the setup for that variable in terms of memory allocation and converting to string
     FeedTime *nextTimeToFeed = malloc(sizeof(FeedTime));
     getClosestDateFromFile(nextTimeToFeed, FILE_TO_WRITE_TO);
-    char *nextTimeToFeedAsString[20];
+    char nextTimeToFeedAsString[20];
     nextFeedTimeToString(nextTimeToFeedAsString, nextTimeToFeed);
 
     //When a menu function is called it will return an id. If the user did nothing it will just return that menu's id, if they participated in an action which required changing
@@ -634,20 +680,22 @@ void menuSelector() {
     int *rotationOffset = malloc(sizeof(int));
     *rotationOffset = currentMotorTurn;
 
-    //For the scrolling menus this is the offset that increments everything in the to scroll list by 1
-    int *scrollOffset = malloc(sizeof(int));
-    *scrollOffset = 0;
-
     //SPEED MENU
     int *rotationSpeed = malloc(sizeof(int));
     *rotationSpeed = ROTATION_SPEED;
 
     while (runningMenus) {
+        hudLoopStart(&menuHud);
+
+        //Read the clock once per pass, each read is a call into the emulator
+        int currentSecond = clockSecond();
+        int currentMinute = clockMinute();
+
         //This condition contains all the operations that require transforming or checking when the seconds increment
-        if (clockSecond() != prev_sec) {
+        if (currentSecond != prev_sec) {
             //We don't need to worry about having a condition for the mode option being Paused as when the system is paused it will not be doing anything anyway
             if (*currentModePtr == Auto) {
-                if (clockMinute() == nextTimeToFeed->minute && clockHour() == nextTimeToFeed->hour && !haveMovedThisMinute) {
+                if (currentMinute == nextTimeToFeed->minute && clockHour() == nextTimeToFeed->hour && !haveMovedThisMinute) {
                     areMoving = 1;
                 }
             }else if (*currentModePtr == Skip) {
@@ -664,17 +712,22 @@ void menuSelector() {
             }
 
             (*timeOutCounter)++;
-            prev_sec = clockSecond();
+            prev_sec = currentSecond;
         }
 
-        if (prev_min != clockMinute()) {
+        if (prev_min != currentMinute) {
             haveMovedThisMinute = 0;
-            prev_min = clockMinute();
+            prev_min = currentMinute;
         }
 
+        // collect all the drawing for this pass of the loop into a single display frame
+        displayBeginFrame();
+
         if (areMoving) {
             motorStep();
             motorDisplay(SCREEN_WIDTH / 20, (SCREEN_HEIGHT / 6) - CHAR_HEIGHT, currentMotorTurn);
+            //The feeding graphic has replaced the menu so it must be drawn again in full afterwards
+            uiInvalidate(&menuScreen);
 
             //When currentMotorTurn == 0 we know we have come to the end of the motor cycle and so reset the relative variables for the next feed time
             if (currentMotorTurn == 0 && rotationsLeftToComplete == 0) {
@@ -693,6 +746,8 @@ void menuSelector() {
             }else {
                 currentMotorTurn--;
             }
+        }else if (displayPowerState() == DisplayOff) {
+            //Nothing is drawn while the screen is off. The loop just waits for a press (below) and checks the feed times
         }else {
 
             //Jump to the menu the user is currently using
@@ -707,19 +762,19 @@ void menuSelector() {
                     menuID = feedMenu(currentModePtr, timeOutCounter);
                 break;
                 case UTILITY_MENU_ID:
-                    menuID = utilityMenu(rangeIndexUt, utilityPtr, scrollOffset, timeOutCounter);
+                    menuID = utilityMenu(rangeIndexUt, utilityPtr, timeOutCounter);
                 break;
                 case DATE_SET_MENU_ID:
                     menuID = dateSetMenu(currentTimeSelectorIndex, currentTimeSelectorValue, feedValuesToSave, timeOutCounter);
                 break;
                 case OPERATING_MODE_MENU_ID:
-                    menuID = operatingModeMenu(currentModePtr, rangeIndexOp, optionPtr, scrollOffset, timeOutCounter);
+                    menuID = operatingModeMenu(currentModePtr, rangeIndexOp, optionPtr, timeOutCounter);
                 break;
                 case SPEED_MENU_ID:
                     menuID = speedMenu(timeOutCounter, rotationSpeed);
                 break;
                 case DISPLAY_TIMES_MENU_ID:
-                    menuID = displayTimesMenu(timesListPtr, rangeIndexDa, *numLinesInFeedFile, scrollOffset, timeOutCounter);
+                    menuID = displayTimesMenu(timesListPtr, rangeIndexDa, *numLinesInFeedFile, timeOutCounter);
                 break;
                 case SET_CLOCK_MENU_ID:
                     menuID = setClockMenu(currentClockSelectorIndex, currentClockSelectorValue, clockValuesToSave, timeOutCounter);
@@ -727,14 +782,35 @@ void menuSelector() {
             }
         }
 
-        //If the user hasn't clicked the button in a while turn the screen off to maintain screen life
+        //If the user hasn't clicked the button in a while dim and then turn the screen off to maintain screen life
         if (*timeOutCounter >= TIMEOUT_TIME) {
-            displayClear();
+            displayPower(DisplayOff);
+            uiInvalidate(&menuScreen);
+        }else if (*timeOutCounter >= DIM_TIME) {
+            displayPower(DisplayDimmed);
+        }else if (displayPowerState() == DisplayDimmed) {
+            displayPower(DisplayOn);
+        }
+
+        if (!areMoving && displayPowerState() != DisplayOff) {
+            //Only the widgets of the menu that have changed are drawn
+            uiPaint(&menuScreen);
         }
 
+        //The overlay goes on top of everything else in the frame
+        hudDraw(&menuHud);
+
+        displayEndFrame();
+
         // check for the button state every 0.2 second
         if (areMoving) {
             msleep(*rotationSpeed);
+        }else if (displayPowerState() == DisplayOff) {
+            //Wait for a press instead of polling. The press only wakes the screen, which is then drawn again in full
+            if (buttonWaitEvent(SCREEN_OFF_WAIT) != NoPress) {
+                *timeOutCounter = 0;
+                displayPower(DisplayOn);
+            }
         }else {
             msleep(100L);
         }
@@ -754,7 +830,7 @@ void menuSelector() {
         free(timesListPtr[i]);
     }
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < 5; i++) {
         free(utilityPtr[i]);
     }
 
@@ -793,6 +869,13 @@ void userProcessing() {
 
     foodFill(50); // fill the food container Note: maximum 50%
 
+    // don't let the GUI hold up the feed timing, display and motor commands are sent by a separate thread
+    jniAsync(true);
+    // the display is redrawn after every motor step while feeding, faster than it can usefully be shown
+    displayFrameRate(10);
+
+    hudInit(&menuHud, hudWhere(getenv(HUD_ENV)));
+
     //Sets up and runs the main menu
     menuSelector();
 }
@@ -814,6 +897,9 @@ int main() {
     // add a log entry for entry to this method
     logAdd(METHOD_ENTRY, "main(). test of Fish Feed Hardware Emulator using a JavaFX GUI and jni");
 
+    // load the feed schedule and build the menus while the JVM and GUI are starting
+    jniPrepare(menuPrepare);
+
     // start the JVM and set up the JNI environment
     // this will result in the userProcessing() function being called to run the C part of the program
     if (jniSetup() != 0) return 1;